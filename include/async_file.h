@@ -0,0 +1,132 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <inttypes.h>
+#include <sys/uio.h>
+#include "log.h"
+
+namespace xie
+{
+  // 批量异步写文件: 日志先拷贝进对齐的大块缓冲, 由后台线程通过io_uring批量提交,
+  // 内核不支持io_uring时退化为pwritev
+  class AsyncFileWriter
+  {
+  public:
+    typedef std::shared_ptr<AsyncFileWriter> ptr;
+
+    struct Options
+    {
+      size_t block_size = 256 * 1024;   // 缓冲块大小, 向上对齐到4096
+      uint32_t max_inflight = 8;        // 同时在途的写请求上限
+      uint32_t max_pending = 16;        // 等待提交的缓冲块上限, 超过后写入方阻塞
+      uint32_t flush_interval_ms = 100; // 未写满的缓冲块最长停留时间
+      bool direct = false;              // 使用O_DIRECT绕过页缓存
+      bool use_uring = true;            // false时强制使用pwritev
+    };
+
+    struct Metrics
+    {
+      uint64_t queue_depth = 0;    // 等待提交的缓冲块数
+      uint64_t inflight = 0;       // 已提交未完成的写请求数
+      uint64_t bytes_written = 0;  // 已写入内核的字节数
+      uint64_t writes = 0;         // 完成的写请求数
+      uint64_t syscalls = 0;       // io_uring_enter/pwritev调用次数
+      uint64_t errors = 0;         // 写失败次数
+      uint64_t avg_latency_us = 0; // 提交到完成的平均耗时
+      uint64_t max_latency_us = 0; // 提交到完成的最大耗时
+    };
+
+    AsyncFileWriter(const std::string &filename);
+    AsyncFileWriter(const std::string &filename, const Options &opt);
+    ~AsyncFileWriter();
+
+    bool isOpen() const { return m_fd >= 0; }
+    bool usingUring() const { return m_ring != nullptr; }
+    const std::string &getFilename() const { return m_filename; }
+    void append(const char *data, size_t len);
+    void append(const std::string &str) { append(str.data(), str.size()); }
+    void flush(); // 阻塞直到此前追加的数据全部写入内核
+    void close(); // 写完剩余数据并停止后台线程
+    Metrics getMetrics() const;
+
+  private:
+    struct Buffer
+    {
+      char *data = nullptr;
+      size_t size = 0;     // 已写入的字节数(含prefix)
+      size_t prefix = 0;   // O_DIRECT模式下从上一块继承的尾部字节
+      size_t done = 0;     // 已落盘的字节数
+      uint64_t offset = 0; // 文件偏移
+      uint64_t seq = 0;    // 封存序号
+      uint64_t submit_us = 0;
+      bool tail = false;   // 未写满就被封存
+      struct iovec iov;
+    };
+    class Ring;
+
+    void open();
+    Buffer *acquire(std::unique_lock<std::mutex> &lock);
+    Buffer *newBuffer();
+    void seal(bool tail);
+    void run();
+    void writeBatch(std::vector<Buffer *> &batch);
+    void writeSync(Buffer *buf);
+    void submitUring(std::vector<Buffer *> &batch, size_t begin, size_t end);
+    void complete(Buffer *buf, int64_t res);
+    void release(std::vector<Buffer *> &batch);
+    size_t writeLength(const Buffer *buf) const;
+
+  private:
+    std::string m_filename;
+    Options m_opt;
+    size_t m_align = 4096;
+    int m_fd = -1;
+    Ring *m_ring = nullptr;
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_writerCond;   // 唤醒后台线程
+    std::condition_variable m_producerCond; // 唤醒等待缓冲的写入方
+    std::condition_variable m_flushCond;    // 唤醒等待flush的调用方
+    Buffer *m_current = nullptr;
+    std::deque<Buffer *> m_pending;
+    std::vector<Buffer *> m_free;
+    size_t m_total = 0;
+    uint64_t m_nextOffset = 0;
+    uint64_t m_sealSeq = 0;
+    uint64_t m_doneSeq = 0;
+    bool m_stop = false;
+    std::thread m_thread;
+
+    std::atomic<uint64_t> m_queueDepth{0};
+    std::atomic<uint64_t> m_inflight{0};
+    std::atomic<uint64_t> m_bytes{0};
+    std::atomic<uint64_t> m_writes{0};
+    std::atomic<uint64_t> m_syscalls{0};
+    std::atomic<uint64_t> m_errors{0};
+    std::atomic<uint64_t> m_latencySum{0};
+    std::atomic<uint64_t> m_latencyMax{0};
+  };
+
+  // 通过AsyncFileWriter批量异步写文件的appender, 适用于高吞吐场景
+  class AsyncFileLogAppender : public logAppender
+  {
+  public:
+    typedef std::shared_ptr<AsyncFileLogAppender> ptr;
+    AsyncFileLogAppender(const std::string &filename);
+    AsyncFileLogAppender(const std::string &filename, const AsyncFileWriter::Options &opt);
+    void log(std::shared_ptr<Logger> logger, LogLevel::Level level, logEvent::ptr event) override;
+    void flush() { m_writer->flush(); }
+    AsyncFileWriter::Metrics getMetrics() const { return m_writer->getMetrics(); }
+    AsyncFileWriter::ptr getWriter() const { return m_writer; }
+
+  private:
+    AsyncFileWriter::ptr m_writer;
+  };
+}
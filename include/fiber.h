@@ -0,0 +1,98 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <functional>
+#include <condition_variable>
+#include <inttypes.h>
+#include <ucontext.h>
+
+namespace xie
+{
+  class Scheduler;
+
+  // 基于ucontext的有栈协程, 由Scheduler的工作线程切入执行, 可以在不同线程间迁移
+  class Fiber : public std::enable_shared_from_this<Fiber>
+  {
+    friend class Scheduler;
+
+  public:
+    typedef std::shared_ptr<Fiber> ptr;
+    enum State
+    {
+      INIT,  // 尚未运行
+      READY, // 在运行队列中等待
+      EXEC,  // 正在运行
+      HOLD,  // 挂起, 等待被唤醒
+      TERM   // 已结束
+    };
+
+    Fiber(std::function<void()> cb, size_t stack_size = 128 * 1024);
+    ~Fiber();
+    uint64_t getId() const { return m_id; }
+    State getState() const { return m_state; }
+
+    // 当前线程正在运行的协程, 不在协程中返回nullptr
+    static Fiber *GetThis();
+    static uint64_t GetFiberId();
+    // 让出执行权, 放回运行队列末尾
+    static void Yield();
+    // 挂起当前协程直到被Scheduler::Wake()唤醒; 切出后由调度线程释放unlock,
+    // 唤醒方必须持有同一把锁才能看到等待者, 因此不会在切出前被唤醒
+    static void Park(std::mutex *unlock);
+
+  private:
+    void resume(); // 由调度线程调用, 切入协程
+    static void MainFunc();
+
+  private:
+    uint64_t m_id;
+    State m_state = INIT;
+    Scheduler *m_scheduler = nullptr; // 最近一次调度它的调度器
+    ucontext_t m_ctx;
+    void *m_stack = nullptr; // 包含保护页的整个映射
+    size_t m_stackSize;      // 可用栈大小, 按页对齐
+    std::function<void()> m_cb;
+  };
+
+  // N个线程共享一个运行队列的协程调度器
+  class Scheduler
+  {
+  public:
+    typedef std::shared_ptr<Scheduler> ptr;
+    Scheduler(size_t threads = 1, const std::string &name = "scheduler");
+    ~Scheduler();
+    const std::string &getName() const { return m_name; }
+    void start();
+    // 等待所有协程结束后退出工作线程
+    void stop();
+    void schedule(std::function<void()> cb);
+    // 新协程或被唤醒的协程放入运行队列
+    void schedule(Fiber::ptr fiber);
+    uint64_t getSwitches() const { return m_switches.load(std::memory_order_relaxed); }
+
+    static Scheduler *GetThis();
+    // 把挂起的协程放回它所属调度器的运行队列, 可以在任意线程调用
+    static void Wake(Fiber::ptr fiber);
+
+  private:
+    void run();
+
+  private:
+    std::string m_name;
+    size_t m_threadCount;
+    std::vector<std::thread> m_threads;
+    std::mutex m_mutex;
+    std::condition_variable m_cond;
+    std::deque<Fiber::ptr> m_queue;
+    size_t m_idle = 0;     // 在m_cond上等待的线程数
+    size_t m_fibers = 0;   // 未结束的协程数
+    bool m_stopping = false;
+    std::atomic<uint64_t> m_switches{0};
+  };
+}
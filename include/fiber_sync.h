@@ -0,0 +1,209 @@
+#pragma once
+
+#include <deque>
+#include <vector>
+#include <mutex>
+#include <limits>
+#include "fiber.h"
+
+namespace xie
+{
+  // 以下同步原语只能在协程中使用: 等待时只挂起当前协程, 所在线程继续运行其他协程;
+  // 唤醒时直接把锁/许可/数据交给被唤醒的协程, 被唤醒者无需再次竞争
+
+  class FiberMutex
+  {
+    friend class FiberCondVar;
+
+  public:
+    void lock();
+    bool try_lock();
+    void unlock();
+
+  private:
+    // 条件变量唤醒时代替fiber获取锁, 锁被占用则转入本锁的等待队列
+    void lockFor(Fiber::ptr fiber);
+
+  private:
+    std::mutex m_mutex;
+    bool m_locked = false;
+    std::deque<Fiber::ptr> m_waiters;
+  };
+
+  class FiberCondVar
+  {
+  public:
+    // 返回时已重新持有mutex
+    void wait(FiberMutex &mutex);
+    template <class Pred>
+    void wait(FiberMutex &mutex, Pred pred)
+    {
+      while (!pred())
+      {
+        wait(mutex);
+      }
+    }
+    void notify_one();
+    void notify_all();
+
+  private:
+    struct Waiter
+    {
+      Fiber::ptr fiber;
+      FiberMutex *mutex;
+    };
+    std::mutex m_mutex;
+    std::deque<Waiter> m_waiters;
+  };
+
+  class FiberSemaphore
+  {
+  public:
+    FiberSemaphore(size_t count = 0) : m_count(count) {}
+    void wait();
+    bool try_wait();
+    void post();
+
+  private:
+    std::mutex m_mutex;
+    size_t m_count;
+    std::deque<Fiber::ptr> m_waiters;
+  };
+
+  // Go风格的通道: 容量为0时收发双方直接交接, kUnbounded表示不限容量(发送永不阻塞)
+  template <class T>
+  class Channel
+  {
+  public:
+    typedef std::shared_ptr<Channel> ptr;
+    static const size_t kUnbounded = std::numeric_limits<size_t>::max();
+
+    Channel(size_t capacity = 0) : m_capacity(capacity) {}
+
+    // 通道已关闭时返回false
+    bool send(const T &v)
+    {
+      T tmp(v);
+      return send(std::move(tmp));
+    }
+
+    bool send(T &&v)
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      if (m_closed)
+      {
+        return false;
+      }
+      if (!m_receivers.empty())
+      {
+        Waiter *w = m_receivers.front();
+        m_receivers.pop_front();
+        *w->value = std::move(v);
+        w->ok = true;
+        lock.unlock();
+        Scheduler::Wake(std::move(w->fiber));
+        return true;
+      }
+      if (m_buffer.size() < m_capacity)
+      {
+        m_buffer.push_back(std::move(v));
+        return true;
+      }
+      Waiter w{Fiber::GetThis()->shared_from_this(), &v, false};
+      m_senders.push_back(&w);
+      lock.release();
+      Fiber::Park(&m_mutex);
+      return w.ok;
+    }
+
+    // 通道已关闭且没有剩余数据时返回false
+    bool recv(T &v)
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      if (!m_buffer.empty())
+      {
+        v = std::move(m_buffer.front());
+        m_buffer.pop_front();
+        // 空出的位置交给等待最久的发送者
+        if (!m_senders.empty())
+        {
+          Waiter *w = m_senders.front();
+          m_senders.pop_front();
+          m_buffer.push_back(std::move(*w->value));
+          w->ok = true;
+          lock.unlock();
+          Scheduler::Wake(std::move(w->fiber));
+        }
+        return true;
+      }
+      if (!m_senders.empty())
+      {
+        Waiter *w = m_senders.front();
+        m_senders.pop_front();
+        v = std::move(*w->value);
+        w->ok = true;
+        lock.unlock();
+        Scheduler::Wake(std::move(w->fiber));
+        return true;
+      }
+      if (m_closed)
+      {
+        return false;
+      }
+      Waiter w{Fiber::GetThis()->shared_from_this(), &v, false};
+      m_receivers.push_back(&w);
+      lock.release();
+      Fiber::Park(&m_mutex);
+      return w.ok;
+    }
+
+    // 唤醒所有等待者: 等待中的发送失败, 接收方取完缓冲数据后失败
+    void close()
+    {
+      std::vector<Fiber::ptr> fibers;
+      {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_closed)
+        {
+          return;
+        }
+        m_closed = true;
+        for (auto i : m_senders)
+        {
+          fibers.push_back(std::move(i->fiber));
+        }
+        for (auto i : m_receivers)
+        {
+          fibers.push_back(std::move(i->fiber));
+        }
+        m_senders.clear();
+        m_receivers.clear();
+      }
+      for (auto &i : fibers)
+      {
+        Scheduler::Wake(std::move(i));
+      }
+    }
+
+    size_t size()
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      return m_buffer.size();
+    }
+
+  private:
+    // 位于挂起协程的栈上, 直到被唤醒前都有效
+    struct Waiter
+    {
+      Fiber::ptr fiber;
+      T *value;
+      bool ok;
+    };
+    std::mutex m_mutex;
+    size_t m_capacity;
+    bool m_closed = false;
+    std::deque<T> m_buffer;
+    std::deque<Waiter *> m_senders;
+    std::deque<Waiter *> m_receivers;
+  };
+}
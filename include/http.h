@@ -0,0 +1,42 @@
+#pragma once
+
+#include <string>
+#include <map>
+#include <memory>
+#include <inttypes.h>
+#include <time.h>
+
+namespace xie
+{
+  // 最小的HTTP/1.x请求解析, 只处理请求行和请求头
+  class HttpRequest
+  {
+  public:
+    typedef std::shared_ptr<HttpRequest> ptr;
+    typedef std::map<std::string, std::string> HeaderMap; // key为小写
+
+    const std::string &getMethod() const { return m_method; }
+    const std::string &getPath() const { return m_path; } // 已做百分号解码, 不含查询串
+    const std::string &getQuery() const { return m_query; }
+    const std::string &getVersion() const { return m_version; }
+    const HeaderMap &getHeaders() const { return m_headers; }
+    std::string getHeader(const std::string &key, const std::string &def = "") const;
+    bool isKeepAlive() const;
+    void clear();
+
+    // 解析data开头的请求头, 返回消耗的字节数; 数据不完整返回0, 格式错误返回-1
+    static int Parse(const char *data, size_t len, HttpRequest &req);
+    // 从fd读取并解析一个请求, buf保存多读的数据供下次使用; 返回false表示连接关闭或出错
+    static bool Read(int fd, std::string &buf, HttpRequest &req);
+
+  private:
+    std::string m_method;
+    std::string m_path;
+    std::string m_query;
+    std::string m_version;
+    HeaderMap m_headers;
+  };
+
+  const char *HttpStatusText(int status);
+  std::string HttpDate(time_t t); // RFC 7231格式的GMT时间
+}
@@ -9,12 +9,14 @@
 #include <sstream>
 #include <iostream>
 #include <map>
+#include <atomic>
+#include <mutex>
 #include "singleton.h"
 #include "util.h"
 
 #define XIE_LOG_LEVEL(logger, level) \
   if (logger->getLevel() <= level)   \
-  xie::LogEventWrap(xie::logEvent::ptr(new xie::logEvent(level, logger, __FILE__, __LINE__, xie::getThreadID(), xie::getFiberID(), 0, time(0)))).getSS()
+  xie::LogEventWrap(xie::logEvent::ptr(new xie::logEvent(level, logger, __FILE__, __LINE__, xie::getThreadID(), xie::getFiberID(), xie::getElapseMS(), time(0)))).getSS()
 #define XIE_LOG_DEBUG(logger) XIE_LOG_LEVEL(logger, xie::LogLevel::DEBUG)
 #define XIE_LOG_INFO(logger) XIE_LOG_LEVEL(logger, xie::LogLevel::INFO)
 #define XIE_LOG_WARN(logger) XIE_LOG_LEVEL(logger, xie::LogLevel::WARN)
@@ -23,7 +25,7 @@
 
 #define XIE_LOG_FMT_LEVEL(logger, level, fmt, ...) \
   if (logger->getLevel() <= level)                 \
-  xie::LogEventWrap(xie::logEvent::ptr(new xie::logEvent(level, logger, __FILE__, __LINE__, xie::getThreadID(), xie::getFiberID(), 0, time(0)))).getEvent()->format(fmt, __VA_ARGS__)
+  xie::LogEventWrap(xie::logEvent::ptr(new xie::logEvent(level, logger, __FILE__, __LINE__, xie::getThreadID(), xie::getFiberID(), xie::getElapseMS(), time(0)))).getEvent()->format(fmt, __VA_ARGS__)
 #define XIE_LOG_FMT_DEBUG(logger, fmt, ...) XIE_LOG_FMT_LEVEL(logger, xie::LogLevel::DEBUG, fmt, __VA_ARGS__)
 #define XIE_LOG_FMT_INFO(logger, fmt, ...) XIE_LOG_FMT_LEVEL(logger, xie::LogLevel::INFO, fmt, __VA_ARGS__)
 #define XIE_LOG_FMT_WARN(logger, fmt, ...) XIE_LOG_FMT_LEVEL(logger, xie::LogLevel::WARN, fmt, __VA_ARGS__)
@@ -31,10 +33,12 @@
 #define XIE_LOG_FMT_FATAL(logger, fmt, ...) XIE_LOG_FMT_LEVEL(logger, xie::LogLevel::FATAL, fmt, __VA_ARGS__)
 
 #define XIE_LOG_ROOT() xie::LogMgr::GetInstance()->getRoot()
+#define XIE_LOG_NAME(name) xie::LogMgr::GetInstance()->getLogger(name)
 
 namespace xie
 {
   class Logger;
+  class LogIndexWriter;
   // 日志级别
   class LogLevel
   {
@@ -99,6 +103,7 @@ namespace xie
     typedef std::shared_ptr<logFormatter> ptr;
     logFormatter(const std::string &pattern);
     std::string format(std::shared_ptr<Logger> logger, LogLevel::Level level, logEvent::ptr event); // 按照一定格式解析logEvent
+    const std::string &getPattern() const { return m_pattern; }
 
     class formatItem
     {
@@ -126,15 +131,26 @@ namespace xie
     void setFormat(logFormatter::ptr val) { m_formater = val; }
     logFormatter::ptr getFormat() const { return m_formater; }
     void setLevel(LogLevel::Level levle) { m_level = levle; }
+    // 不低于该级别的日志写入后立即刷新; 默认不主动刷新, 由流缓冲区写满时批量写出
+    void setFlushLevel(LogLevel::Level level)
+    {
+      m_flushLevel = level;
+      m_flush = true;
+    }
 
   protected:
     LogLevel::Level m_level = LogLevel::DEBUG;
+    LogLevel::Level m_flushLevel = LogLevel::FATAL;
+    bool m_flush = false;
     logFormatter::ptr m_formater;
   };
 
   // 日志
+  // 按名字中的'.'组成层级, 未设置级别时继承父logger的级别, 输出时依次交给自身和祖先的appender
   class Logger : public std::enable_shared_from_this<Logger>
   {
+    friend class LogManager;
+
   public:
     typedef std::shared_ptr<Logger> ptr;
 
@@ -147,14 +163,27 @@ namespace xie
     void error(logEvent::ptr event);
     void addAppender(logAppender::ptr appender);
     void delAppender(logAppender::ptr appender);
-    LogLevel::Level getLevel() const { return m_level; }
-    void setLevel(LogLevel::Level level) { m_level = level; }
+    LogLevel::Level getLevel() const { return m_effective.load(std::memory_order_relaxed); } // 生效的级别
+    void setLevel(LogLevel::Level level);                                                   // 设置级别并传递给继承级别的子logger
+    void resetLevel();                                                                      // 清除自身级别, 改为继承父logger
+    bool hasLevel() const { return m_hasLevel; }
+    void setAdditive(bool v) { m_additive = v; } // false时不再使用祖先的appender
+    bool isAdditive() const { return m_additive; }
     const std::string &getName() const { return m_name; }
+    Logger::ptr getParent() const { return m_parent; }
 
   private:
-    std::string m_name;                     // 日志名称
-    LogLevel::Level m_level;                // 日志级别
-    std::list<logAppender::ptr> m_appender; // Appender集合
+    void setParent(Logger::ptr parent);
+    void updateEffective(LogLevel::Level level);
+
+  private:
+    std::string m_name;                        // 日志名称
+    bool m_hasLevel = true;                    // 是否设置了自身级别, 未设置时m_effective跟随父logger
+    std::atomic<LogLevel::Level> m_effective;  // 生效的日志级别
+    bool m_additive = true;                    // 是否继承祖先的appender
+    Logger::ptr m_parent;                      // 父logger
+    std::vector<Logger *> m_children;          // 子logger, 由LogManager持有
+    std::list<logAppender::ptr> m_appender;    // Appender集合
     logFormatter::ptr m_formatter;
   };
 
@@ -170,25 +199,44 @@ namespace xie
   {
   public:
     typedef std::shared_ptr<FileLogAppender> ptr;
-    FileLogAppender(const std::string &filename);
+    FileLogAppender(const std::string &filename, bool index = false); // index为true时同时生成<filename>.idx时间索引
     void log(std::shared_ptr<Logger> logger, LogLevel::Level level, logEvent::ptr event) override;
     bool reopen(); // 重新打开文件，文件打开成功，返回true
 
   private:
     std::string m_filename;
     std::ofstream m_filestream;
+    uint64_t m_offset = 0; // 已写入的字节数
+    std::shared_ptr<LogIndexWriter> m_index;
   };
 
+  // logger注册表: 只增不删的哈希表, 查找无锁, 创建时加锁
+  // 返回的引用指向注册表内的节点, 在LogManager生命周期内有效; 查找本身不修改引用计数,
+  // 需要长期持有时再自行拷贝
   class LogManager
   {
   public:
     LogManager();
-    Logger::ptr getLogger(const std::string &name);
+    ~LogManager();
+    const Logger::ptr &getLogger(const std::string &name); // 不存在时按层级创建, 父logger一并创建
     void init();
-    Logger::ptr getRoot() const { return m_root; }
+    const Logger::ptr &getRoot() const { return m_root; }
+
+  private:
+    struct Node
+    {
+      std::string name;
+      Logger::ptr logger;
+      Node *next;
+    };
+    static const size_t kBuckets = 256;
+
+    const Logger::ptr *find(const std::string &name, size_t hash) const; // 不存在时返回nullptr
+    const Logger::ptr &create(const std::string &name);                  // 调用方需持有m_mutex
 
   private:
-    std::map<std::string, Logger::ptr> m_loggers;
+    std::atomic<Node *> m_buckets[kBuckets];
+    std::mutex m_mutex;
     Logger::ptr m_root;
   };
   typedef Singleton<LogManager> LogMgr;
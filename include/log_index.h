@@ -0,0 +1,62 @@
+#pragma once
+
+#include <string>
+#include <memory>
+#include <fstream>
+#include <unordered_map>
+#include <inttypes.h>
+#include "log.h"
+
+namespace xie
+{
+  // 日志索引文件(<日志文件>.idx)格式:
+  //   文件头: magic "XIELOGI1" | uint32 版本 | uint32 pattern长度 | pattern
+  //   之后是定长的LogIndexEntry, 每条描述日志文件中一个块, 块总是从一条日志的开头开始
+  struct LogIndexEntry
+  {
+    uint64_t offset;      // 块在日志文件中的偏移
+    uint64_t length;      // 块长度
+    int64_t min_time;     // 块内最早的时间戳(秒)
+    int64_t max_time;     // 块内最晚的时间戳(秒)
+    uint64_t name_bloom;  // logger名及其各级父名字的布隆过滤器
+    uint32_t records;     // 块内日志条数
+    uint32_t level_mask;  // 块内出现过的级别, 1 << LogLevel::Level
+  };
+
+  class LogIndex
+  {
+  public:
+    static const char *kMagic;
+    static const uint32_t kVersion = 1;
+    static std::string IndexFile(const std::string &logfile) { return logfile + ".idx"; }
+    // "a.b.c"会同时加入"a"、"a.b"、"a.b.c", 便于按父logger过滤
+    static uint64_t NameBloom(const std::string &name);
+    static uint64_t NameBit(const std::string &name);
+  };
+
+  // 随日志写入生成稀疏索引, 每累计block_size字节生成一条LogIndexEntry
+  class LogIndexWriter
+  {
+  public:
+    typedef std::shared_ptr<LogIndexWriter> ptr;
+    LogIndexWriter(const std::string &logfile, size_t block_size = 64 * 1024);
+    ~LogIndexWriter();
+    // 记录一条从offset开始、长度为len的日志
+    void append(int64_t time, LogLevel::Level level, const std::string &name, uint64_t offset, size_t len);
+    void setPattern(const std::string &pattern) { m_pattern = pattern; } // 写入文件头, 供读取时解析日志
+    void reset(); // 日志文件被截断时重建索引
+    void flush(); // 结束当前块并写出
+
+  private:
+    void writeEntry();
+
+  private:
+    std::string m_filename;
+    std::string m_pattern;
+    size_t m_blockSize;
+    std::ofstream m_ofs;
+    bool m_header = false;
+    LogIndexEntry m_entry;
+    std::unordered_map<std::string, uint64_t> m_blooms;
+  };
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <inttypes.h>
+#include "log_index.h"
+
+namespace xie
+{
+  // 基于mmap和LogIndexWriter生成的稀疏索引查询日志文件:
+  // 按时间二分定位候选块, 用块内级别/logger摘要剪枝, 再多线程并行扫描
+  class LogReader
+  {
+  public:
+    typedef std::shared_ptr<LogReader> ptr;
+
+    struct Query
+    {
+      int64_t begin = INT64_MIN; // 时间范围(秒), 闭区间
+      int64_t end = INT64_MAX;
+      uint32_t level_mask = ~0u; // 1 << LogLevel::Level
+      std::string logger;        // 非空时只匹配该logger及其子logger
+      size_t threads = 0;        // 扫描线程数, 0表示使用全部核
+    };
+
+    // 指向mmap中的一段连续日志, 相邻的匹配记录会合并, LogReader析构后失效
+    struct Record
+    {
+      const char *data;
+      size_t size;
+    };
+
+    struct Stats
+    {
+      size_t blocks = 0;         // 索引块总数
+      size_t blocks_scanned = 0; // 逐行解析的块
+      size_t blocks_copied = 0;  // 整块命中, 无需解析
+      uint64_t bytes_scanned = 0;
+      size_t records = 0; // 匹配的日志条数(整块命中时按索引计数)
+    };
+
+    LogReader(const std::string &logfile);
+    ~LogReader();
+    bool open(); // 映射日志文件并加载索引, 没有索引时整个文件按一个块扫描
+    bool hasIndex() const { return m_hasIndex; }
+    const std::string &getPattern() const { return m_pattern; }
+    void setPattern(const std::string &pattern) { m_pattern = pattern; } // 覆盖索引中记录的日志格式
+    std::vector<Record> query(const Query &q, Stats *stats = nullptr) const;
+
+  private:
+    class Parser;
+    struct Task
+    {
+      uint64_t offset;
+      uint64_t length;
+      uint32_t records;
+      bool copy; // 整块命中
+    };
+    void scan(const Task &task, const Query &q, Parser &parser, std::vector<Record> &out, size_t &records) const;
+    bool loadIndex();
+
+  private:
+    std::string m_filename;
+    std::string m_pattern;
+    int m_fd = -1;
+    const char *m_data = nullptr;
+    size_t m_size = 0;
+    bool m_hasIndex = false;
+    std::vector<LogIndexEntry> m_entries;
+  };
+}
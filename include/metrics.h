@@ -0,0 +1,220 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <functional>
+#include <condition_variable>
+#include <stdexcept>
+#include <inttypes.h>
+#include "log.h"
+
+namespace xie
+{
+  // 每个CPU一个分片, 按当前运行的CPU选择, 抓取时才合并; 线程数多于分片数时
+  // 共用分片的线程不会同时运行, 热点路径上没有多核争用同一缓存行
+  size_t GetMetricShardCount();
+  size_t GetMetricShard();
+
+  class MetricBase
+  {
+  public:
+    typedef std::shared_ptr<MetricBase> ptr;
+    MetricBase(const std::string &name, const std::string &description = "") : m_name(name), m_description(description) {}
+    virtual ~MetricBase() {}
+    const std::string &GetName() const { return m_name; }
+    const std::string &GetDescription() const { return m_description; }
+    virtual const char *GetType() const = 0;
+    virtual void dump(std::ostream &os) const = 0; // 输出文本格式, 名字中的'.'替换为'_'
+
+  protected:
+    std::string m_name;
+    std::string m_description;
+  };
+
+  // 只增计数器
+  class Counter : public MetricBase
+  {
+  public:
+    typedef std::shared_ptr<Counter> ptr;
+    Counter(const std::string &name, const std::string &description = "") : MetricBase(name, description), m_shards(new Shard[GetMetricShardCount()]) {}
+    void inc(uint64_t v = 1) { m_shards[GetMetricShard()].value.fetch_add(v, std::memory_order_relaxed); }
+    uint64_t GetValue() const;
+    const char *GetType() const override { return "counter"; }
+    void dump(std::ostream &os) const override;
+
+  private:
+    struct alignas(64) Shard
+    {
+      std::atomic<uint64_t> value{0};
+    };
+    std::unique_ptr<Shard[]> m_shards;
+  };
+
+  // 瞬时值, set语义无法分片, 只占用独立的缓存行
+  class Gauge : public MetricBase
+  {
+  public:
+    typedef std::shared_ptr<Gauge> ptr;
+    Gauge(const std::string &name, const std::string &description = "") : MetricBase(name, description) {}
+    void set(int64_t v) { m_value.store(v, std::memory_order_relaxed); }
+    void add(int64_t v) { m_value.fetch_add(v, std::memory_order_relaxed); }
+    int64_t GetValue() const { return m_value.load(std::memory_order_relaxed); }
+    const char *GetType() const override { return "gauge"; }
+    void dump(std::ostream &os) const override;
+
+  private:
+    alignas(64) std::atomic<int64_t> m_value{0};
+  };
+
+  // HDR风格的对数线性直方图: 每个2的幂区间再分16个子桶, 相对误差不超过1/16
+  class Histogram : public MetricBase
+  {
+  public:
+    typedef std::shared_ptr<Histogram> ptr;
+    static const size_t kSubBits = 4;
+    static const size_t kSubCount = 1 << kSubBits;
+    static const size_t kBuckets = 2 * kSubCount + (63 - kSubBits) * kSubCount;
+
+    struct Snapshot
+    {
+      uint64_t count = 0;
+      uint64_t sum = 0;
+      std::vector<uint64_t> buckets;
+      uint64_t percentile(double p) const; // p取值0~100, 返回所在桶的上界
+      uint64_t max() const;
+      double mean() const { return count ? (double)sum / count : 0; }
+    };
+
+    // RAII计时, 析构时记录经过的微秒数
+    class Timer
+    {
+    public:
+      Timer(Histogram::ptr h) : m_histogram(h), m_begin(std::chrono::steady_clock::now()) {}
+      ~Timer() { m_histogram->observe(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - m_begin).count()); }
+
+    private:
+      Histogram::ptr m_histogram;
+      std::chrono::steady_clock::time_point m_begin;
+    };
+
+    Histogram(const std::string &name, const std::string &description = "");
+    void observe(uint64_t v)
+    {
+      Shard &s = m_shards[GetMetricShard()];
+      s.buckets[BucketIndex(v)].fetch_add(1, std::memory_order_relaxed);
+      s.sum.fetch_add(v, std::memory_order_relaxed);
+    }
+    Snapshot GetSnapshot() const;
+    const char *GetType() const override { return "summary"; }
+    void dump(std::ostream &os) const override;
+
+    static size_t BucketIndex(uint64_t v)
+    {
+      if (v < 2 * kSubCount)
+      {
+        return v;
+      }
+      size_t e = 63 - __builtin_clzll(v);
+      return 2 * kSubCount + (e - kSubBits - 1) * kSubCount + ((v >> (e - kSubBits)) & (kSubCount - 1));
+    }
+    static uint64_t BucketUpper(size_t idx);
+
+  private:
+    struct alignas(64) Shard
+    {
+      std::atomic<uint64_t> sum{0};
+      std::atomic<uint64_t> buckets[kBuckets];
+    };
+    std::unique_ptr<Shard[]> m_shards;
+  };
+
+  class Metrics
+  {
+  public:
+    typedef std::map<std::string, MetricBase::ptr> MetricMap;
+
+    template <typename T>
+    static typename T::ptr Lookup(const std::string &name)
+    {
+      std::lock_guard<std::mutex> lock(GetMutex());
+      auto it = GetDatas().find(name);
+      if (it == GetDatas().end())
+      {
+        return nullptr;
+      }
+      return std::dynamic_pointer_cast<T>(it->second);
+    }
+
+    template <typename T>
+    static typename T::ptr Lookup(const std::string &name, const std::string &description)
+    {
+      if (name.find_first_not_of("ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz._0123456789") != std::string::npos)
+      {
+        XIE_LOG_ERROR(XIE_LOG_ROOT()) << "Metrics look up name invalid: " << name;
+        throw std::invalid_argument(name);
+      }
+      std::lock_guard<std::mutex> lock(GetMutex());
+      auto it = GetDatas().find(name);
+      if (it != GetDatas().end())
+      {
+        auto tmp = std::dynamic_pointer_cast<T>(it->second);
+        if (!tmp)
+        {
+          XIE_LOG_ERROR(XIE_LOG_ROOT()) << "Metrics look up name: " << name << " exists with type " << it->second->GetType();
+          throw std::invalid_argument(name);
+        }
+        return tmp;
+      }
+      typename T::ptr v(new T(name, description));
+      GetDatas()[name] = v;
+      return v;
+    }
+
+    static void Visit(std::function<void(MetricBase::ptr)> cb);
+    static std::string ToText(); // 所有指标的文本格式(Prometheus exposition)
+
+  private:
+    static MetricMap &GetDatas()
+    {
+      static MetricMap s_datas;
+      return s_datas;
+    }
+    static std::mutex &GetMutex()
+    {
+      static std::mutex s_mutex;
+      return s_mutex;
+    }
+  };
+
+  // 后台线程定期把所有指标输出到logger, 并交给导出回调
+  class MetricsDumper
+  {
+  public:
+    typedef std::shared_ptr<MetricsDumper> ptr;
+    typedef std::function<void(const std::string &text)> ExportHook;
+    MetricsDumper(Logger::ptr logger, uint32_t interval_ms = 10000);
+    ~MetricsDumper();
+    void setHook(ExportHook hook);
+    void start();
+    void stop();
+    void dump(); // 立即输出一次
+
+  private:
+    void run();
+
+  private:
+    Logger::ptr m_logger;
+    uint32_t m_interval;
+    ExportHook m_hook;
+    bool m_stop = true;
+    std::mutex m_mutex;
+    std::condition_variable m_cond;
+    std::thread m_thread;
+  };
+}
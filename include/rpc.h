@@ -0,0 +1,182 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <future>
+#include <functional>
+#include <condition_variable>
+#include <unordered_map>
+#include <inttypes.h>
+#include <sys/uio.h>
+
+namespace xie
+{
+  class RpcStatus
+  {
+  public:
+    enum Code
+    {
+      OK = 0,
+      NOT_FOUND, // 服务端没有注册该方法
+      TIMEOUT,   // 超过截止时间
+      ERROR,     // 处理函数返回失败
+      CLOSED     // 连接断开
+    };
+    static const char *toString(RpcStatus::Code code);
+  };
+
+  // 帧格式(网络字节序):
+  //   uint32 length | uint8 type | uint8 status | uint16 method_len | uint64 id | uint32 timeout_ms | method | payload
+  // length为length字段之后的字节数, 同一连接上的多个请求靠id区分, 响应可以乱序返回
+  struct RpcFrame
+  {
+    enum Type
+    {
+      REQUEST = 1,
+      RESPONSE = 2
+    };
+    static const size_t kHeaderSize = 20;
+    static const uint32_t kMaxSize = 16 * 1024 * 1024;
+
+    uint8_t type = REQUEST;
+    uint8_t status = RpcStatus::OK;
+    uint64_t id = 0;
+    uint32_t timeout_ms = 0; // 请求剩余的超时时间, 0表示不限
+    std::string method;
+    std::string payload;
+
+    void encode(std::string &out) const;
+    // 从data开头解码一帧, 返回消耗的字节数; 数据不完整返回0, 格式错误返回-1
+    static int64_t Decode(const char *data, size_t len, RpcFrame &frame);
+  };
+
+  // 多个线程并发发送时, 由第一个发送者把队列中已有的帧合并成一次writev写出
+  class RpcWriter
+  {
+  public:
+    typedef std::shared_ptr<RpcWriter> ptr;
+    RpcWriter(int fd) : m_fd(fd) {}
+    bool send(std::string &&frame);
+    void cork();   // 暂存发送的帧
+    bool uncork(); // 一次写出暂存的帧
+    uint64_t getFrames() const { return m_frames.load(std::memory_order_relaxed); }
+    uint64_t getWrites() const { return m_writes.load(std::memory_order_relaxed); }
+
+  private:
+    bool flush(std::unique_lock<std::mutex> &lock);
+
+  private:
+    int m_fd;
+    std::mutex m_mutex;
+    std::vector<std::string> m_queue;
+    bool m_writing = false;
+    bool m_error = false;
+    int m_cork = 0;
+    std::atomic<uint64_t> m_frames{0};
+    std::atomic<uint64_t> m_writes{0};
+  };
+
+  class RpcServer
+  {
+  public:
+    typedef std::shared_ptr<RpcServer> ptr;
+    // 返回false时客户端收到RpcStatus::ERROR
+    typedef std::function<bool(const std::string &request, std::string &response)> Handler;
+
+    RpcServer(size_t workers = 4);
+    ~RpcServer();
+    void registerHandler(const std::string &method, Handler handler);
+    bool bind(const std::string &ip, uint16_t port); // port为0时随机分配
+    uint16_t getPort() const { return m_port; }
+    void start();
+    void stop();
+
+  private:
+    struct Connection;
+    struct Task
+    {
+      std::shared_ptr<Connection> conn;
+      RpcFrame frame;
+      uint64_t deadline_us;
+    };
+    void acceptLoop();
+    void readLoop(std::shared_ptr<Connection> conn);
+    void workLoop();
+    void process(Task &task);
+
+  private:
+    size_t m_workerCount;
+    int m_listen = -1;
+    uint16_t m_port = 0;
+    std::atomic<bool> m_stop{true};
+    std::map<std::string, Handler> m_handlers;
+    std::thread m_acceptThread;
+    std::vector<std::thread> m_workers;
+    std::mutex m_mutex;
+    std::condition_variable m_cond;
+    std::deque<Task> m_tasks;
+    std::mutex m_connMutex;
+    std::vector<std::shared_ptr<Connection>> m_conns;
+  };
+
+  class RpcClient
+  {
+  public:
+    typedef std::shared_ptr<RpcClient> ptr;
+    struct Result
+    {
+      RpcStatus::Code status = RpcStatus::OK;
+      std::string data;
+    };
+    // 回调在客户端的读线程中执行, 不应阻塞
+    typedef std::function<void(Result &&result)> Callback;
+
+    // RAII批量发送: 作用域内发出的请求在析构时合并成一次写
+    class Batch
+    {
+    public:
+      Batch(RpcClient &client) : m_client(client) { m_client.m_writer->cork(); }
+      ~Batch() { m_client.m_writer->uncork(); }
+
+    private:
+      RpcClient &m_client;
+    };
+
+    RpcClient();
+    ~RpcClient();
+    bool connect(const std::string &ip, uint16_t port);
+    void close();
+    std::future<Result> call(const std::string &method, const std::string &request, uint32_t timeout_ms = 0);
+    void call(const std::string &method, const std::string &request, Callback cb, uint32_t timeout_ms = 0);
+    uint64_t getFrames() const { return m_writer ? m_writer->getFrames() : 0; }
+    uint64_t getWrites() const { return m_writer ? m_writer->getWrites() : 0; }
+
+  private:
+    struct Pending
+    {
+      Callback cb;
+      uint64_t deadline_us;
+    };
+    void readLoop();
+    void complete(uint64_t id, Result &&result);
+    void expire();
+    void failAll();
+
+  private:
+    int m_fd = -1;
+    int m_wakeup = -1; // eventfd, 出现更早的截止时间时唤醒读线程
+    RpcWriter::ptr m_writer;
+    std::atomic<uint64_t> m_nextId{1};
+    std::atomic<bool> m_closed{true};
+    std::mutex m_mutex;
+    std::unordered_map<uint64_t, Pending> m_pending;
+    std::multimap<uint64_t, uint64_t> m_deadlines; // 截止时间 -> 请求id
+    std::thread m_reader;
+  };
+}
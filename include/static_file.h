@@ -0,0 +1,102 @@
+#pragma once
+
+#include <string>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <unordered_map>
+#include <sys/stat.h>
+#include "http.h"
+
+namespace xie
+{
+  // 缓存已打开的文件描述符、stat结果和预先拼好的响应头, 通过inotify在文件变化时失效
+  // 按路径哈希分片加锁, 命中时只在分片锁内查找和调整LRU; inotify事件由后台线程处理,
+  // 文件修改后缓存在事件送达时失效
+  class FileCache
+  {
+  public:
+    typedef std::shared_ptr<FileCache> ptr;
+
+    struct Entry
+    {
+      typedef std::shared_ptr<Entry> ptr;
+      ~Entry();
+      std::string path;
+      int fd = -1;
+      struct stat st;
+      std::string etag;
+      std::string headers; // Content-Type/Last-Modified/ETag/Accept-Ranges
+      bool inlined = false; // 小文件的内容缓存在body中, 与响应头一次写出
+      std::string body;
+    };
+    // 不超过该大小的文件缓存内容, 省掉单独的sendfile调用
+    static const size_t kInlineSize = 16 * 1024;
+
+    FileCache(size_t capacity = 1024);
+    ~FileCache();
+    Entry::ptr get(const std::string &path); // 文件不存在或不是普通文件时返回nullptr
+    void invalidate(const std::string &path);
+    size_t size();
+    uint64_t getHits();
+    uint64_t getMisses();
+    uint64_t getInvalidations() const { return m_invalidations.load(std::memory_order_relaxed); }
+
+  private:
+    typedef std::list<Entry::ptr> LruList;
+    static const size_t kShards = 16;
+    struct Shard
+    {
+      std::mutex mutex;
+      LruList lru; // 表头为最近使用
+      std::unordered_map<std::string, LruList::iterator> entries;
+      uint64_t gen = 0; // 每次失效时递增, 打开文件期间发生变化则结果不入缓存
+      uint64_t hits = 0;
+      uint64_t misses = 0;
+    };
+    Shard &shardOf(const std::string &path);
+    Entry::ptr open(const std::string &path);
+    void watch(const std::string &dir);
+    void eventLoop();
+    void processEvents();                              // 读取inotify事件, 在后台线程调用
+    void eraseLocked(Shard &shard, const std::string &path); // 调用方需持有分片锁
+    void eraseDir(const std::string &dir);
+    void clear();
+
+  private:
+    size_t m_capacity; // 每个分片的容量
+    Shard m_shards[kShards];
+    int m_inotify = -1;
+    int m_wakeup = -1; // eventfd, 析构时唤醒后台线程
+    std::thread m_thread;
+    std::mutex m_watchMutex;
+    std::unordered_map<int, std::string> m_wdDirs; // watch描述符 -> 目录
+    std::unordered_map<std::string, int> m_dirWds; // 目录 -> watch描述符
+    std::atomic<uint64_t> m_invalidations{0};
+  };
+
+  // 静态文件服务: 响应体通过sendfile直接从页缓存发送到socket, 支持HEAD、单段Range和If-None-Match
+  class StaticFileHandler
+  {
+  public:
+    typedef std::shared_ptr<StaticFileHandler> ptr;
+    StaticFileHandler(const std::string &root, size_t cache_capacity = 1024);
+    // 处理一个请求并写出完整响应, 返回false表示应关闭连接
+    bool handle(int sockfd, const HttpRequest &req);
+    FileCache &getCache() { return m_cache; }
+
+  private:
+    bool sendError(int sockfd, int status, bool keepalive);
+
+  private:
+    std::string m_root;
+    FileCache m_cache;
+  };
+
+  // 向fd写完len字节, 非阻塞socket上等待可写
+  bool WriteAll(int fd, const char *data, size_t len, int flags = 0);
+  // 用sendfile把in_fd中[offset, offset+len)发送到out_fd
+  bool SendFile(int out_fd, int in_fd, uint64_t offset, uint64_t len);
+}
@@ -0,0 +1,170 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <fstream>
+#include <inttypes.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#define XIE_TRACE_CAT_IMPL(a, b) a##b
+#define XIE_TRACE_CAT(a, b) XIE_TRACE_CAT_IMPL(a, b)
+// 记录当前作用域的耗时, name需为字符串常量
+#define XIE_TRACE_SCOPE(name) xie::TraceSpan XIE_TRACE_CAT(xie_trace_span_, __LINE__)(name)
+#define XIE_TRACE_FUNC() XIE_TRACE_SCOPE(__func__)
+
+namespace xie
+{
+  // 低开销时钟: x86上直接读TSC, 导出时再换算成纳秒
+  class TraceClock
+  {
+  public:
+    static uint64_t now()
+    {
+#if defined(__x86_64__) || defined(__i386__)
+      return __rdtsc();
+#else
+      struct timespec ts;
+      clock_gettime(CLOCK_MONOTONIC, &ts);
+      return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+#endif
+    }
+    static uint64_t nowNS(); // CLOCK_MONOTONIC纳秒, 用于校准
+  };
+
+  struct TraceEvent
+  {
+    const char *name; // 必须是静态存储期的字符串
+    uint64_t begin;   // TraceClock计数
+    uint64_t end;
+  };
+
+  // 单线程写、导出线程读的无锁环形缓冲, 写满时丢弃新事件
+  class TraceRing
+  {
+  public:
+    typedef std::shared_ptr<TraceRing> ptr;
+    static const size_t kSize = 1 << 14;
+
+    TraceRing(uint32_t tid) : m_tid(tid) {}
+    bool push(const char *name, uint64_t begin, uint64_t end)
+    {
+      uint64_t head = m_head.load(std::memory_order_relaxed);
+      if (head - m_tailCache >= kSize)
+      {
+        m_tailCache = m_tail.load(std::memory_order_acquire);
+        if (head - m_tailCache >= kSize)
+        {
+          m_dropped.fetch_add(1, std::memory_order_relaxed);
+          return false;
+        }
+      }
+      TraceEvent &e = m_events[head & (kSize - 1)];
+      e.name = name;
+      e.begin = begin;
+      e.end = end;
+      m_head.store(head + 1, std::memory_order_release);
+      return true;
+    }
+    size_t drain(std::vector<TraceEvent> &out);
+    uint32_t getTid() const { return m_tid; }
+    uint64_t getDropped() const { return m_dropped.load(std::memory_order_relaxed); }
+    bool isExited() const { return m_exited.load(std::memory_order_acquire); }
+    void setExited() { m_exited.store(true, std::memory_order_release); }
+
+  private:
+    TraceEvent m_events[kSize];
+    alignas(64) std::atomic<uint64_t> m_head{0};
+    uint64_t m_tailCache = 0; // 写线程缓存的读位置, 减少跨核读取
+    alignas(64) std::atomic<uint64_t> m_tail{0};
+    std::atomic<uint64_t> m_dropped{0};
+    std::atomic<bool> m_exited{false};
+    uint32_t m_tid;
+  };
+
+  class Tracer
+  {
+  public:
+    struct ThreadEvents
+    {
+      uint32_t tid;
+      std::vector<TraceEvent> events;
+    };
+
+    static bool IsEnabled() { return s_enabled.load(std::memory_order_relaxed); }
+    static void SetEnabled(bool v) { s_enabled.store(v, std::memory_order_relaxed); }
+    static void Record(const char *name, uint64_t begin, uint64_t end) { GetRing()->push(name, begin, end); }
+    // 取出所有线程缓冲中的事件, 并清理已退出且读空的线程缓冲
+    static void Collect(std::vector<ThreadEvents> &out);
+    static uint64_t GetDropped();
+    // 每个TraceClock计数对应的纳秒数
+    static double NSPerTick();
+    // TraceClock计数换算为启动后的纳秒
+    static double TicksToNS(uint64_t ticks, double ns_per_tick);
+
+  private:
+    // 不内联: 协程挂起后可能在其他线程恢复, 每次都要重新取当前线程的缓冲
+    static TraceRing *GetRing();
+    static TraceRing *CreateRing();
+
+  private:
+    static std::atomic<bool> s_enabled;
+  };
+
+  // RAII耗时区间, 关闭追踪时只有一次原子读
+  class TraceSpan
+  {
+  public:
+    TraceSpan(const char *name) : m_name(name), m_begin(Tracer::IsEnabled() ? TraceClock::now() : 0) {}
+    ~TraceSpan()
+    {
+      if (m_begin)
+      {
+        Tracer::Record(m_name, m_begin, TraceClock::now());
+      }
+    }
+
+  private:
+    TraceSpan(const TraceSpan &) = delete;
+    TraceSpan &operator=(const TraceSpan &) = delete;
+
+  private:
+    const char *m_name;
+    uint64_t m_begin;
+  };
+
+  // 后台线程定期把追踪事件写成Chrome trace JSON, 可直接用chrome://tracing或Perfetto打开
+  class TraceExporter
+  {
+  public:
+    typedef std::shared_ptr<TraceExporter> ptr;
+    TraceExporter(const std::string &filename, uint32_t interval_ms = 200);
+    ~TraceExporter();
+    bool start(); // 打开文件并开启追踪
+    void stop();  // 关闭追踪, 写出剩余事件并补全JSON
+    void flush(); // 立即导出一次
+
+  private:
+    void run();
+    void exportEvents();
+
+  private:
+    std::string m_filename;
+    uint32_t m_interval;
+    std::ofstream m_ofs;
+    bool m_first = true;
+    bool m_stop = true;
+    std::vector<uint32_t> m_namedTids;
+    std::vector<Tracer::ThreadEvents> m_events;
+    std::mutex m_mutex;
+    std::condition_variable m_cond;
+    std::thread m_thread;
+  };
+}
@@ -8,4 +8,6 @@ namespace xie
   // 获取当前线程id,以int类型返回
   uint32_t getThreadID();
   uint32_t getFiberID();
+  // 进程启动到现在的毫秒数
+  uint32_t getElapseMS();
 }
\ No newline at end of file
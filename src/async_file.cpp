@@ -0,0 +1,623 @@
+#include "async_file.h"
+#include <fcntl.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <limits.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#include <chrono>
+#include <algorithm>
+
+namespace xie
+{
+  static uint64_t nowUS()
+  {
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+  }
+
+  // 直接使用系统调用的最小io_uring封装, 只支持IORING_OP_WRITEV
+  class AsyncFileWriter::Ring
+  {
+  public:
+    static Ring *Create(unsigned entries)
+    {
+#if defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter)
+      Ring *ring = new Ring;
+      if (!ring->init(entries))
+      {
+        delete ring;
+        return nullptr;
+      }
+      return ring;
+#else
+      return nullptr;
+#endif
+    }
+
+    ~Ring()
+    {
+      if (m_sqes != MAP_FAILED)
+      {
+        munmap(m_sqes, m_sqesSize);
+      }
+      if (m_cqPtr != MAP_FAILED && m_cqPtr != m_sqPtr)
+      {
+        munmap(m_cqPtr, m_cqSize);
+      }
+      if (m_sqPtr != MAP_FAILED)
+      {
+        munmap(m_sqPtr, m_sqSize);
+      }
+      if (m_fd >= 0)
+      {
+        ::close(m_fd);
+      }
+    }
+
+    // 填充一个writev请求, 提交队列满时返回false
+    bool push(int fd, struct iovec *iov, uint64_t offset, void *data)
+    {
+      unsigned tail = *m_sqTail;
+      if (tail - __atomic_load_n(m_sqHead, __ATOMIC_ACQUIRE) >= m_sqEntries)
+      {
+        return false;
+      }
+      unsigned idx = tail & *m_sqMask;
+      struct io_uring_sqe *sqe = &m_sqes[idx];
+      memset(sqe, 0, sizeof(*sqe));
+      sqe->opcode = IORING_OP_WRITEV;
+      sqe->fd = fd;
+      sqe->addr = (uint64_t)(uintptr_t)iov;
+      sqe->len = 1;
+      sqe->off = offset;
+      sqe->user_data = (uint64_t)(uintptr_t)data;
+      m_sqArray[idx] = idx;
+      __atomic_store_n(m_sqTail, tail + 1, __ATOMIC_RELEASE);
+      return true;
+    }
+
+    int enter(unsigned submit, unsigned wait)
+    {
+      return (int)syscall(__NR_io_uring_enter, m_fd, submit, wait, wait ? IORING_ENTER_GETEVENTS : 0, nullptr, 0);
+    }
+
+    template <typename F>
+    void reap(F f)
+    {
+      unsigned head = *m_cqHead;
+      unsigned tail = __atomic_load_n(m_cqTail, __ATOMIC_ACQUIRE);
+      while (head != tail)
+      {
+        struct io_uring_cqe *cqe = &m_cqes[head & *m_cqMask];
+        f((void *)(uintptr_t)cqe->user_data, cqe->res);
+        ++head;
+      }
+      __atomic_store_n(m_cqHead, head, __ATOMIC_RELEASE);
+    }
+
+  private:
+    bool init(unsigned entries)
+    {
+      struct io_uring_params p;
+      memset(&p, 0, sizeof(p));
+      m_fd = (int)syscall(__NR_io_uring_setup, entries, &p);
+      if (m_fd < 0)
+      {
+        return false;
+      }
+      m_sqEntries = p.sq_entries;
+      m_sqSize = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+      m_cqSize = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+      bool single = p.features & IORING_FEAT_SINGLE_MMAP;
+      if (single)
+      {
+        m_sqSize = m_cqSize = std::max(m_sqSize, m_cqSize);
+      }
+      m_sqPtr = mmap(nullptr, m_sqSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQ_RING);
+      if (m_sqPtr == MAP_FAILED)
+      {
+        return false;
+      }
+      m_cqPtr = single ? m_sqPtr : mmap(nullptr, m_cqSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_CQ_RING);
+      if (m_cqPtr == MAP_FAILED)
+      {
+        return false;
+      }
+      m_sqesSize = p.sq_entries * sizeof(struct io_uring_sqe);
+      m_sqes = (struct io_uring_sqe *)mmap(nullptr, m_sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQES);
+      if (m_sqes == MAP_FAILED)
+      {
+        return false;
+      }
+      char *sq = (char *)m_sqPtr;
+      char *cq = (char *)m_cqPtr;
+      m_sqHead = (unsigned *)(sq + p.sq_off.head);
+      m_sqTail = (unsigned *)(sq + p.sq_off.tail);
+      m_sqMask = (unsigned *)(sq + p.sq_off.ring_mask);
+      m_sqArray = (unsigned *)(sq + p.sq_off.array);
+      m_cqHead = (unsigned *)(cq + p.cq_off.head);
+      m_cqTail = (unsigned *)(cq + p.cq_off.tail);
+      m_cqMask = (unsigned *)(cq + p.cq_off.ring_mask);
+      m_cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+      return true;
+    }
+
+  private:
+    int m_fd = -1;
+    unsigned m_sqEntries = 0;
+    size_t m_sqSize = 0;
+    size_t m_cqSize = 0;
+    size_t m_sqesSize = 0;
+    void *m_sqPtr = MAP_FAILED;
+    void *m_cqPtr = MAP_FAILED;
+    struct io_uring_sqe *m_sqes = (struct io_uring_sqe *)MAP_FAILED;
+    struct io_uring_cqe *m_cqes = nullptr;
+    unsigned *m_sqHead = nullptr;
+    unsigned *m_sqTail = nullptr;
+    unsigned *m_sqMask = nullptr;
+    unsigned *m_sqArray = nullptr;
+    unsigned *m_cqHead = nullptr;
+    unsigned *m_cqTail = nullptr;
+    unsigned *m_cqMask = nullptr;
+  };
+
+  AsyncFileWriter::AsyncFileWriter(const std::string &filename) : AsyncFileWriter(filename, Options())
+  {
+  }
+
+  AsyncFileWriter::AsyncFileWriter(const std::string &filename, const Options &opt) : m_filename(filename), m_opt(opt)
+  {
+    m_opt.block_size = (std::max(m_opt.block_size, m_align) + m_align - 1) & ~(m_align - 1);
+    m_opt.max_inflight = std::max(m_opt.max_inflight, 1u);
+    m_opt.max_pending = std::max(m_opt.max_pending, 1u);
+    m_opt.flush_interval_ms = std::max(m_opt.flush_interval_ms, 1u);
+    open();
+    if (m_fd < 0)
+    {
+      return;
+    }
+    if (m_opt.use_uring)
+    {
+      m_ring = Ring::Create(m_opt.max_inflight);
+    }
+    m_thread = std::thread(&AsyncFileWriter::run, this);
+  }
+
+  AsyncFileWriter::~AsyncFileWriter()
+  {
+    close();
+  }
+
+  void AsyncFileWriter::open()
+  {
+    int flags = O_CREAT | O_CLOEXEC | (m_opt.direct ? O_RDWR | O_DIRECT : O_WRONLY);
+    m_fd = ::open(m_filename.c_str(), flags, 0644);
+    if (m_fd < 0 && m_opt.direct)
+    {
+      // tmpfs等文件系统不支持O_DIRECT
+      m_opt.direct = false;
+      m_fd = ::open(m_filename.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+    }
+    if (m_fd < 0)
+    {
+      XIE_LOG_ERROR(XIE_LOG_ROOT()) << "AsyncFileWriter open " << m_filename << " failed: " << strerror(errno);
+      return;
+    }
+    struct stat st;
+    m_nextOffset = fstat(m_fd, &st) == 0 ? st.st_size : 0;
+    if (m_opt.direct && (m_nextOffset & (m_align - 1)))
+    {
+      // O_DIRECT要求偏移对齐, 读回文件末尾不足一页的数据, 随下一块一起重写
+      std::unique_lock<std::mutex> lock(m_mutex);
+      Buffer *buf = acquire(lock);
+      buf->offset = m_nextOffset & ~(uint64_t)(m_align - 1);
+      ssize_t n = pread(m_fd, buf->data, m_align, buf->offset);
+      buf->size = buf->prefix = n > 0 ? n : 0;
+      m_nextOffset = buf->offset;
+      m_current = buf;
+    }
+  }
+
+  AsyncFileWriter::Buffer *AsyncFileWriter::acquire(std::unique_lock<std::mutex> &lock)
+  {
+    m_producerCond.wait(lock, [this]()
+                        { return !m_free.empty() || m_total < m_opt.max_pending + m_opt.max_inflight; });
+    return newBuffer();
+  }
+
+  // 优先复用空闲缓冲块, 调用方需持有m_mutex
+  AsyncFileWriter::Buffer *AsyncFileWriter::newBuffer()
+  {
+    Buffer *buf = nullptr;
+    if (!m_free.empty())
+    {
+      buf = m_free.back();
+      m_free.pop_back();
+    }
+    else
+    {
+      void *p = nullptr;
+      if (posix_memalign(&p, m_align, m_opt.block_size) != 0)
+      {
+        throw std::bad_alloc();
+      }
+      buf = new Buffer;
+      buf->data = (char *)p;
+      ++m_total;
+    }
+    buf->size = buf->prefix = buf->done = 0;
+    buf->tail = false;
+    return buf;
+  }
+
+  void AsyncFileWriter::append(const char *data, size_t len)
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (m_stop || m_fd < 0)
+    {
+      return;
+    }
+    while (len > 0)
+    {
+      if (!m_current)
+      {
+        Buffer *buf = acquire(lock);
+        if (m_current)
+        {
+          // 等待期间其它线程已经换上了新的缓冲块
+          m_free.push_back(buf);
+          continue;
+        }
+        buf->offset = m_nextOffset;
+        m_current = buf;
+      }
+      size_t n = std::min(len, m_opt.block_size - m_current->size);
+      memcpy(m_current->data + m_current->size, data, n);
+      m_current->size += n;
+      data += n;
+      len -= n;
+      if (m_current->size == m_opt.block_size)
+      {
+        seal(false);
+      }
+    }
+  }
+
+  // 封存当前缓冲块并交给后台线程, 调用方需持有m_mutex
+  void AsyncFileWriter::seal(bool tail)
+  {
+    Buffer *buf = m_current;
+    m_current = nullptr;
+    buf->tail = tail && buf->size < m_opt.block_size;
+    buf->seq = ++m_sealSeq;
+    if (buf->tail && m_opt.direct)
+    {
+      // 尾块按页补齐写入, 不足一页的部分拷贝到下一块开头, 下次连同新数据覆盖写
+      size_t aligned = buf->size & ~(m_align - 1);
+      m_nextOffset = buf->offset + aligned;
+      size_t rest = buf->size - aligned;
+      if (rest)
+      {
+        Buffer *next = newBuffer();
+        memcpy(next->data, buf->data + aligned, rest);
+        next->size = next->prefix = rest;
+        next->offset = m_nextOffset;
+        m_current = next;
+      }
+    }
+    else
+    {
+      m_nextOffset = buf->offset + buf->size;
+    }
+    m_pending.push_back(buf);
+    m_queueDepth.store(m_pending.size(), std::memory_order_relaxed);
+    m_writerCond.notify_one();
+  }
+
+  void AsyncFileWriter::flush()
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (m_fd < 0)
+    {
+      return;
+    }
+    if (m_current && m_current->size > m_current->prefix)
+    {
+      seal(true);
+    }
+    uint64_t target = m_sealSeq;
+    m_flushCond.wait(lock, [this, target]()
+                     { return m_doneSeq >= target; });
+  }
+
+  void AsyncFileWriter::close()
+  {
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      if (m_stop)
+      {
+        return;
+      }
+      m_stop = true;
+    }
+    m_writerCond.notify_one();
+    if (m_thread.joinable())
+    {
+      m_thread.join();
+    }
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_current)
+    {
+      m_free.push_back(m_current);
+      m_current = nullptr;
+    }
+    for (auto &i : m_free)
+    {
+      free(i->data);
+      delete i;
+    }
+    m_free.clear();
+    delete m_ring;
+    m_ring = nullptr;
+    if (m_fd >= 0)
+    {
+      ::close(m_fd);
+      m_fd = -1;
+    }
+    m_flushCond.notify_all();
+  }
+
+  AsyncFileWriter::Metrics AsyncFileWriter::getMetrics() const
+  {
+    Metrics m;
+    m.queue_depth = m_queueDepth.load(std::memory_order_relaxed);
+    m.inflight = m_inflight.load(std::memory_order_relaxed);
+    m.bytes_written = m_bytes.load(std::memory_order_relaxed);
+    m.writes = m_writes.load(std::memory_order_relaxed);
+    m.syscalls = m_syscalls.load(std::memory_order_relaxed);
+    m.errors = m_errors.load(std::memory_order_relaxed);
+    m.avg_latency_us = m.writes ? m_latencySum.load(std::memory_order_relaxed) / m.writes : 0;
+    m.max_latency_us = m_latencyMax.load(std::memory_order_relaxed);
+    return m;
+  }
+
+  void AsyncFileWriter::run()
+  {
+    std::vector<Buffer *> batch;
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true)
+    {
+      m_writerCond.wait_for(lock, std::chrono::milliseconds(m_opt.flush_interval_ms), [this]()
+                            { return !m_pending.empty() || m_stop; });
+      if (m_pending.empty() && m_current && m_current->size > m_current->prefix)
+      {
+        // 超时或退出时, 把未写满的缓冲块也写出去
+        seal(true);
+      }
+      if (m_pending.empty())
+      {
+        if (m_stop)
+        {
+          break;
+        }
+        continue;
+      }
+      batch.assign(m_pending.begin(), m_pending.end());
+      m_pending.clear();
+      m_queueDepth.store(0, std::memory_order_relaxed);
+      lock.unlock();
+      writeBatch(batch);
+      lock.lock();
+      m_doneSeq = batch.back()->seq;
+      release(batch);
+      m_producerCond.notify_all();
+      m_flushCond.notify_all();
+    }
+  }
+
+  size_t AsyncFileWriter::writeLength(const Buffer *buf) const
+  {
+    return m_opt.direct ? (buf->size + m_align - 1) & ~(m_align - 1) : buf->size;
+  }
+
+  void AsyncFileWriter::writeBatch(std::vector<Buffer *> &batch)
+  {
+    for (auto &i : batch)
+    {
+      size_t len = writeLength(i);
+      if (len > i->size)
+      {
+        memset(i->data + i->size, 0, len - i->size);
+      }
+      i->iov.iov_base = i->data;
+      i->iov.iov_len = len;
+      i->done = 0;
+      i->submit_us = nowUS();
+    }
+    size_t i = 0;
+    while (i < batch.size())
+    {
+      // O_DIRECT下的尾块会被后续块覆盖, 需等之前的请求完成后单独同步写入并截断文件
+      size_t j = i;
+      while (j < batch.size() && !(m_opt.direct && batch[j]->tail))
+      {
+        ++j;
+      }
+      if (j > i && m_ring)
+      {
+        submitUring(batch, i, j);
+      }
+      else
+      {
+        for (size_t k = i; k < j;)
+        {
+          struct iovec iov[IOV_MAX];
+          int cnt = 0;
+          size_t total = 0;
+          size_t e = k;
+          while (e < j && cnt < IOV_MAX && batch[e]->offset == batch[k]->offset + total)
+          {
+            iov[cnt++] = batch[e]->iov;
+            total += batch[e]->iov.iov_len;
+            ++e;
+          }
+          ssize_t n = pwritev(m_fd, iov, cnt, batch[k]->offset);
+          m_syscalls.fetch_add(1, std::memory_order_relaxed);
+          for (size_t x = k; x < e; ++x)
+          {
+            if (n == (ssize_t)total)
+            {
+              complete(batch[x], batch[x]->iov.iov_len);
+            }
+            else
+            {
+              // 部分写入或失败时逐块重试, pwrite按偏移写入可重复执行
+              writeSync(batch[x]);
+            }
+          }
+          k = e;
+        }
+      }
+      if (j < batch.size())
+      {
+        writeSync(batch[j]);
+        if (ftruncate(m_fd, batch[j]->offset + batch[j]->size) != 0)
+        {
+          m_errors.fetch_add(1, std::memory_order_relaxed);
+        }
+        ++j;
+      }
+      i = j;
+    }
+  }
+
+  void AsyncFileWriter::submitUring(std::vector<Buffer *> &batch, size_t begin, size_t end)
+  {
+    size_t next = begin;
+    unsigned pending = 0;  // 已放入提交队列但内核尚未接收
+    uint32_t inflight = 0; // 内核已接收, 等待完成
+    while (next < end || pending > 0 || inflight > 0)
+    {
+      while (next < end && pending + inflight < m_opt.max_inflight && m_ring->push(m_fd, &batch[next]->iov, batch[next]->offset, batch[next]))
+      {
+        ++pending;
+        ++next;
+      }
+      m_inflight.store(pending + inflight, std::memory_order_relaxed);
+      // 只接收了部分请求时内核不会等待完成, 剩余的留在提交队列中下一轮继续提交
+      int rt = m_ring->enter(pending, pending + inflight ? 1 : 0);
+      m_syscalls.fetch_add(1, std::memory_order_relaxed);
+      if (rt >= 0)
+      {
+        pending -= rt;
+        inflight += rt;
+      }
+      else if (errno != EINTR && errno != EAGAIN && errno != EBUSY)
+      {
+        // io_uring不可用, 之后不再使用io_uring. 内核已接收的请求仍可能在使用缓冲块,
+        // 必须等到它们的完成事件后才能归还缓冲块; 完成队列是共享内存, 等待失败时轮询收割
+        m_errors.fetch_add(1, std::memory_order_relaxed);
+        while (inflight > 0)
+        {
+          if (m_ring->enter(0, 1) < 0 && errno != EINTR)
+          {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+          }
+          m_ring->reap([this, &inflight](void *data, int res)
+                       {
+                         --inflight;
+                         complete((Buffer *)data, res); });
+        }
+        // 内核按顺序消费提交队列, 末尾的pending个请求和尚未放入的请求从未被接收, 改为同步写入
+        for (size_t k = next - pending; k < end; ++k)
+        {
+          writeSync(batch[k]);
+        }
+        delete m_ring;
+        m_ring = nullptr;
+        m_inflight.store(0, std::memory_order_relaxed);
+        return;
+      }
+      // EAGAIN/EBUSY时没有请求被接收, 先收割完成事件腾出空间再重试
+      m_ring->reap([this, &inflight](void *data, int res)
+                   {
+                     --inflight;
+                     complete((Buffer *)data, res); });
+    }
+    m_inflight.store(0, std::memory_order_relaxed);
+  }
+
+  void AsyncFileWriter::complete(Buffer *buf, int64_t res)
+  {
+    if (res < 0)
+    {
+      m_errors.fetch_add(1, std::memory_order_relaxed);
+      writeSync(buf);
+      return;
+    }
+    buf->done += res;
+    m_bytes.fetch_add(res, std::memory_order_relaxed);
+    if (buf->done < buf->iov.iov_len)
+    {
+      writeSync(buf);
+      return;
+    }
+    uint64_t cost = nowUS() - buf->submit_us;
+    m_writes.fetch_add(1, std::memory_order_relaxed);
+    m_latencySum.fetch_add(cost, std::memory_order_relaxed);
+    uint64_t max = m_latencyMax.load(std::memory_order_relaxed);
+    while (cost > max && !m_latencyMax.compare_exchange_weak(max, cost, std::memory_order_relaxed))
+    {
+    }
+  }
+
+  void AsyncFileWriter::writeSync(Buffer *buf)
+  {
+    size_t len = buf->iov.iov_len;
+    while (buf->done < len)
+    {
+      ssize_t n = pwrite(m_fd, buf->data + buf->done, len - buf->done, buf->offset + buf->done);
+      m_syscalls.fetch_add(1, std::memory_order_relaxed);
+      if (n <= 0)
+      {
+        if (n < 0 && errno == EINTR)
+        {
+          continue;
+        }
+        m_errors.fetch_add(1, std::memory_order_relaxed);
+        return;
+      }
+      buf->done += n;
+      m_bytes.fetch_add(n, std::memory_order_relaxed);
+    }
+    complete(buf, 0);
+  }
+
+  void AsyncFileWriter::release(std::vector<Buffer *> &batch)
+  {
+    for (auto &i : batch)
+    {
+      m_free.push_back(i);
+    }
+    batch.clear();
+  }
+
+  AsyncFileLogAppender::AsyncFileLogAppender(const std::string &filename) : m_writer(new AsyncFileWriter(filename))
+  {
+  }
+
+  AsyncFileLogAppender::AsyncFileLogAppender(const std::string &filename, const AsyncFileWriter::Options &opt) : m_writer(new AsyncFileWriter(filename, opt))
+  {
+  }
+
+  void AsyncFileLogAppender::log(std::shared_ptr<Logger> logger, LogLevel::Level level, logEvent::ptr event)
+  {
+    if (level >= m_level)
+    {
+      m_writer->append(m_formater->format(logger, level, event));
+    }
+  }
+}
@@ -0,0 +1,245 @@
+#include "fiber.h"
+#include "log.h"
+#include <stdlib.h>
+#include <unistd.h>
+#include <new>
+#include <sys/mman.h>
+
+namespace xie
+{
+  static std::atomic<uint64_t> s_fiberId{0};
+
+  struct FiberThreadState
+  {
+    Fiber *fiber = nullptr;
+    Scheduler *scheduler = nullptr;
+    std::mutex *unlock = nullptr; // 协程切出后由调度线程释放
+    ucontext_t ctx;               // 调度线程自身的上下文
+  };
+
+  static thread_local FiberThreadState t_state;
+
+  // 协程可能在另一个线程上恢复, 不能让编译器缓存切换前的线程局部变量地址
+  static __attribute__((noinline)) FiberThreadState *threadState()
+  {
+    FiberThreadState *s = &t_state;
+    asm volatile(""
+                 : "+r"(s));
+    return s;
+  }
+
+  static size_t pageSize()
+  {
+    static size_t s_page = sysconf(_SC_PAGESIZE);
+    return s_page;
+  }
+
+  // 栈底(低地址)留一页PROT_NONE保护页, 栈溢出时立即SIGSEGV而不是写坏相邻内存
+  Fiber::Fiber(std::function<void()> cb, size_t stack_size)
+      : m_id(++s_fiberId), m_cb(cb)
+  {
+    size_t page = pageSize();
+    m_stackSize = (stack_size + page - 1) / page * page;
+    m_stack = mmap(nullptr, m_stackSize + page, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK, -1, 0);
+    if (m_stack == MAP_FAILED)
+    {
+      m_stack = nullptr;
+      throw std::bad_alloc();
+    }
+    mprotect(m_stack, page, PROT_NONE);
+    getcontext(&m_ctx);
+    m_ctx.uc_link = nullptr;
+    m_ctx.uc_stack.ss_sp = (char *)m_stack + page;
+    m_ctx.uc_stack.ss_size = m_stackSize;
+    makecontext(&m_ctx, &Fiber::MainFunc, 0);
+  }
+
+  Fiber::~Fiber()
+  {
+    if (m_stack)
+    {
+      munmap(m_stack, m_stackSize + pageSize());
+    }
+  }
+
+  Fiber *Fiber::GetThis()
+  {
+    return threadState()->fiber;
+  }
+
+  uint64_t Fiber::GetFiberId()
+  {
+    Fiber *f = threadState()->fiber;
+    return f ? f->m_id : 0;
+  }
+
+  void Fiber::Yield()
+  {
+    FiberThreadState *s = threadState();
+    Fiber *cur = s->fiber;
+    if (!cur)
+    {
+      std::this_thread::yield();
+      return;
+    }
+    cur->m_state = READY;
+    swapcontext(&cur->m_ctx, &s->ctx);
+  }
+
+  void Fiber::Park(std::mutex *unlock)
+  {
+    FiberThreadState *s = threadState();
+    Fiber *cur = s->fiber;
+    cur->m_state = HOLD;
+    s->unlock = unlock;
+    swapcontext(&cur->m_ctx, &s->ctx);
+  }
+
+  void Fiber::resume()
+  {
+    FiberThreadState *s = threadState();
+    s->fiber = this;
+    m_state = EXEC;
+    swapcontext(&s->ctx, &m_ctx);
+    s->fiber = nullptr;
+  }
+
+  void Fiber::MainFunc()
+  {
+    Fiber *cur = threadState()->fiber;
+    try
+    {
+      cur->m_cb();
+    }
+    catch (std::exception &e)
+    {
+      XIE_LOG_ERROR(XIE_LOG_ROOT()) << "fiber " << cur->m_id << " exception: " << e.what();
+    }
+    cur->m_cb = nullptr;
+    cur->m_state = TERM;
+    // 协程执行期间可能已迁移到其他线程, 重新取当前线程的调度上下文
+    setcontext(&threadState()->ctx);
+  }
+
+  Scheduler::Scheduler(size_t threads, const std::string &name)
+      : m_name(name), m_threadCount(threads ? threads : 1)
+  {
+  }
+
+  Scheduler::~Scheduler()
+  {
+    stop();
+  }
+
+  Scheduler *Scheduler::GetThis()
+  {
+    return threadState()->scheduler;
+  }
+
+  void Scheduler::Wake(Fiber::ptr fiber)
+  {
+    Scheduler *sched = fiber->m_scheduler;
+    sched->schedule(std::move(fiber));
+  }
+
+  void Scheduler::start()
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_threads.empty())
+    {
+      return;
+    }
+    m_stopping = false;
+    for (size_t i = 0; i < m_threadCount; ++i)
+    {
+      m_threads.push_back(std::thread(&Scheduler::run, this));
+    }
+  }
+
+  void Scheduler::stop()
+  {
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_stopping = true;
+    }
+    m_cond.notify_all();
+    for (auto &i : m_threads)
+    {
+      i.join();
+    }
+    m_threads.clear();
+  }
+
+  void Scheduler::schedule(std::function<void()> cb)
+  {
+    schedule(Fiber::ptr(new Fiber(cb)));
+  }
+
+  void Scheduler::schedule(Fiber::ptr fiber)
+  {
+    bool notify;
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      if (fiber->m_state == Fiber::INIT)
+      {
+        ++m_fibers;
+      }
+      fiber->m_state = Fiber::READY;
+      fiber->m_scheduler = this;
+      m_queue.push_back(std::move(fiber));
+      notify = m_idle > 0;
+    }
+    if (notify)
+    {
+      m_cond.notify_one();
+    }
+  }
+
+  void Scheduler::run()
+  {
+    threadState()->scheduler = this;
+    while (true)
+    {
+      Fiber::ptr fiber;
+      {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while (m_queue.empty() && !(m_stopping && m_fibers == 0))
+        {
+          ++m_idle;
+          m_cond.wait(lock);
+          --m_idle;
+        }
+        if (m_queue.empty())
+        {
+          break;
+        }
+        fiber = std::move(m_queue.front());
+        m_queue.pop_front();
+      }
+      fiber->resume();
+      m_switches.fetch_add(1, std::memory_order_relaxed);
+      // 释放锁之后协程可能立即被其他线程唤醒并修改状态, 先读出来
+      Fiber::State state = fiber->m_state;
+      FiberThreadState *s = threadState();
+      if (s->unlock)
+      {
+        s->unlock->unlock();
+        s->unlock = nullptr;
+      }
+      if (state == Fiber::READY)
+      {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_queue.push_back(std::move(fiber));
+      }
+      else if (state == Fiber::TERM)
+      {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (--m_fibers == 0 && m_stopping)
+        {
+          m_cond.notify_all();
+        }
+      }
+    }
+    threadState()->scheduler = nullptr;
+  }
+}
@@ -0,0 +1,132 @@
+#include "fiber_sync.h"
+
+namespace xie
+{
+  void FiberMutex::lock()
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (!m_locked)
+    {
+      m_locked = true;
+      return;
+    }
+    m_waiters.push_back(Fiber::GetThis()->shared_from_this());
+    lock.release();
+    // 被唤醒时锁已经由unlock()转交给本协程
+    Fiber::Park(&m_mutex);
+  }
+
+  bool FiberMutex::try_lock()
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_locked)
+    {
+      return false;
+    }
+    m_locked = true;
+    return true;
+  }
+
+  void FiberMutex::unlock()
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (m_waiters.empty())
+    {
+      m_locked = false;
+      return;
+    }
+    Fiber::ptr next = std::move(m_waiters.front());
+    m_waiters.pop_front();
+    lock.unlock();
+    Scheduler::Wake(std::move(next));
+  }
+
+  void FiberMutex::lockFor(Fiber::ptr fiber)
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (m_locked)
+    {
+      m_waiters.push_back(std::move(fiber));
+      return;
+    }
+    m_locked = true;
+    lock.unlock();
+    Scheduler::Wake(std::move(fiber));
+  }
+
+  void FiberCondVar::wait(FiberMutex &mutex)
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_waiters.push_back(Waiter{Fiber::GetThis()->shared_from_this(), &mutex});
+    // 持有m_mutex时释放mutex, notify在本协程挂起之前无法取到它
+    mutex.unlock();
+    lock.release();
+    Fiber::Park(&m_mutex);
+  }
+
+  void FiberCondVar::notify_one()
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (m_waiters.empty())
+    {
+      return;
+    }
+    Waiter w = std::move(m_waiters.front());
+    m_waiters.pop_front();
+    lock.unlock();
+    // 直接转入mutex的等待队列, 避免被唤醒后再去争抢通知方仍持有的锁
+    w.mutex->lockFor(std::move(w.fiber));
+  }
+
+  void FiberCondVar::notify_all()
+  {
+    std::deque<Waiter> waiters;
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      waiters.swap(m_waiters);
+    }
+    for (auto &i : waiters)
+    {
+      i.mutex->lockFor(std::move(i.fiber));
+    }
+  }
+
+  void FiberSemaphore::wait()
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (m_count > 0)
+    {
+      --m_count;
+      return;
+    }
+    m_waiters.push_back(Fiber::GetThis()->shared_from_this());
+    lock.release();
+    // 被唤醒时post()已把许可直接交给本协程
+    Fiber::Park(&m_mutex);
+  }
+
+  bool FiberSemaphore::try_wait()
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_count == 0)
+    {
+      return false;
+    }
+    --m_count;
+    return true;
+  }
+
+  void FiberSemaphore::post()
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (m_waiters.empty())
+    {
+      ++m_count;
+      return;
+    }
+    Fiber::ptr next = std::move(m_waiters.front());
+    m_waiters.pop_front();
+    lock.unlock();
+    Scheduler::Wake(std::move(next));
+  }
+}
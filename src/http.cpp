@@ -0,0 +1,184 @@
+#include "http.h"
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <errno.h>
+#include <unistd.h>
+#include <algorithm>
+
+namespace xie
+{
+  static const size_t kMaxHeaderSize = 64 * 1024;
+
+  std::string HttpRequest::getHeader(const std::string &key, const std::string &def) const
+  {
+    std::string k = key;
+    std::transform(k.begin(), k.end(), k.begin(), ::tolower);
+    auto it = m_headers.find(k);
+    return it == m_headers.end() ? def : it->second;
+  }
+
+  bool HttpRequest::isKeepAlive() const
+  {
+    std::string conn = getHeader("connection");
+    if (m_version == "HTTP/1.0")
+    {
+      return strcasecmp(conn.c_str(), "keep-alive") == 0;
+    }
+    return strcasecmp(conn.c_str(), "close") != 0;
+  }
+
+  void HttpRequest::clear()
+  {
+    m_method.clear();
+    m_path.clear();
+    m_query.clear();
+    m_version.clear();
+    m_headers.clear();
+  }
+
+  static int hexValue(char c)
+  {
+    if (c >= '0' && c <= '9')
+    {
+      return c - '0';
+    }
+    c = tolower(c);
+    return c >= 'a' && c <= 'f' ? c - 'a' + 10 : -1;
+  }
+
+  static bool decodePath(const char *data, size_t len, std::string &out)
+  {
+    out.clear();
+    for (size_t i = 0; i < len; ++i)
+    {
+      if (data[i] == '%')
+      {
+        if (i + 2 >= len || hexValue(data[i + 1]) < 0 || hexValue(data[i + 2]) < 0)
+        {
+          return false;
+        }
+        out.append(1, (char)(hexValue(data[i + 1]) * 16 + hexValue(data[i + 2])));
+        i += 2;
+      }
+      else
+      {
+        out.append(1, data[i]);
+      }
+    }
+    return out.find('\0') == std::string::npos;
+  }
+
+  int HttpRequest::Parse(const char *data, size_t len, HttpRequest &req)
+  {
+    const char *end = (const char *)memmem(data, len, "\r\n\r\n", 4);
+    if (!end)
+    {
+      return len > kMaxHeaderSize ? -1 : 0;
+    }
+    req.clear();
+    const char *line = data;
+    const char *lineEnd = (const char *)memmem(line, end - line + 2, "\r\n", 2);
+    const char *sp1 = (const char *)memchr(line, ' ', lineEnd - line);
+    const char *sp2 = sp1 ? (const char *)memchr(sp1 + 1, ' ', lineEnd - sp1 - 1) : nullptr;
+    if (!sp1 || !sp2)
+    {
+      return -1;
+    }
+    req.m_method.assign(line, sp1);
+    req.m_version.assign(sp2 + 1, lineEnd);
+    const char *target = sp1 + 1;
+    const char *q = (const char *)memchr(target, '?', sp2 - target);
+    if (q)
+    {
+      req.m_query.assign(q + 1, sp2);
+    }
+    if (!decodePath(target, (q ? q : sp2) - target, req.m_path) || req.m_path.empty() || req.m_path[0] != '/' || req.m_version.compare(0, 5, "HTTP/") != 0)
+    {
+      return -1;
+    }
+    for (line = lineEnd + 2; line < end + 2; line = lineEnd + 2)
+    {
+      lineEnd = (const char *)memmem(line, end + 2 - line, "\r\n", 2);
+      const char *colon = (const char *)memchr(line, ':', lineEnd - line);
+      if (!colon)
+      {
+        return -1;
+      }
+      std::string key(line, colon);
+      std::transform(key.begin(), key.end(), key.begin(), ::tolower);
+      const char *v = colon + 1;
+      while (v < lineEnd && (*v == ' ' || *v == '\t'))
+      {
+        ++v;
+      }
+      const char *ve = lineEnd;
+      while (ve > v && (ve[-1] == ' ' || ve[-1] == '\t'))
+      {
+        --ve;
+      }
+      req.m_headers[key].assign(v, ve);
+    }
+    return end + 4 - data;
+  }
+
+  bool HttpRequest::Read(int fd, std::string &buf, HttpRequest &req)
+  {
+    char tmp[4096];
+    while (true)
+    {
+      int n = Parse(buf.data(), buf.size(), req);
+      if (n < 0)
+      {
+        return false;
+      }
+      if (n > 0)
+      {
+        buf.erase(0, n);
+        return true;
+      }
+      ssize_t rt = read(fd, tmp, sizeof(tmp));
+      if (rt < 0 && errno == EINTR)
+      {
+        continue;
+      }
+      if (rt <= 0)
+      {
+        return false;
+      }
+      buf.append(tmp, rt);
+    }
+  }
+
+  const char *HttpStatusText(int status)
+  {
+    switch (status)
+    {
+#define XX(code, text) \
+  case code:           \
+    return text;
+
+      XX(200, "OK");
+      XX(206, "Partial Content");
+      XX(304, "Not Modified");
+      XX(400, "Bad Request");
+      XX(403, "Forbidden");
+      XX(404, "Not Found");
+      XX(405, "Method Not Allowed");
+      XX(416, "Range Not Satisfiable");
+      XX(500, "Internal Server Error");
+#undef XX
+    default:
+      return "Unknown";
+    }
+  }
+
+  std::string HttpDate(time_t t)
+  {
+    struct tm tm;
+    gmtime_r(&t, &tm);
+    char buf[64];
+    strftime(buf, sizeof(buf), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+    return buf;
+  }
+}
@@ -1,4 +1,5 @@
 #include "log.h"
+#include "log_index.h"
 #include <stdarg.h>
 #include <map>
 #include <functional>
@@ -155,7 +156,7 @@ namespace xie
 
     void format(std::shared_ptr<Logger> logger, std::ostream &ofs, LogLevel::Level level, logEvent::ptr event) override
     {
-      ofs << std::endl;
+      ofs << '\n';
     }
   };
   class NameFormatItem : public logFormatter::formatItem
@@ -214,19 +215,69 @@ namespace xie
     }
   }
 
-  Logger::Logger(const std::string &name) : m_name(name), m_level(LogLevel::DEBUG)
+  // 保护logger层级关系和级别传递
+  static std::mutex &GetTreeMutex()
+  {
+    static std::mutex s_mutex;
+    return s_mutex;
+  }
+
+  Logger::Logger(const std::string &name) : m_name(name), m_effective(LogLevel::DEBUG)
   {
     m_formatter.reset(new logFormatter("%d%T%t%T%F%T[%p]%T[%c]%T%f:%l%T%m%n"));
   }
 
   void Logger::log(LogLevel::Level level, logEvent::ptr event)
   {
-    if (level >= m_level)
+    if (level >= getLevel())
     {
       auto self = shared_from_this();
-      for (auto &i : m_appender)
+      for (Logger *l = this; l; l = l->m_additive ? l->m_parent.get() : nullptr)
+      {
+        for (auto &i : l->m_appender)
+        {
+          i->log(self, level, event);
+        }
+      }
+    }
+  }
+
+  void Logger::setLevel(LogLevel::Level level)
+  {
+    std::lock_guard<std::mutex> lock(GetTreeMutex());
+    m_hasLevel = true;
+    updateEffective(level);
+  }
+
+  void Logger::resetLevel()
+  {
+    std::lock_guard<std::mutex> lock(GetTreeMutex());
+    if (!m_parent)
+    {
+      return;
+    }
+    m_hasLevel = false;
+    updateEffective(m_parent->getLevel());
+  }
+
+  void Logger::setParent(Logger::ptr parent)
+  {
+    std::lock_guard<std::mutex> lock(GetTreeMutex());
+    m_parent = parent;
+    m_hasLevel = false;
+    parent->m_children.push_back(this);
+    updateEffective(parent->getLevel());
+  }
+
+  // 只向下传递到没有设置自身级别的子logger, 调用方需持有GetTreeMutex()
+  void Logger::updateEffective(LogLevel::Level level)
+  {
+    m_effective.store(level, std::memory_order_relaxed);
+    for (auto &i : m_children)
+    {
+      if (!i->m_hasLevel)
       {
-        i->log(self, level, event);
+        i->updateEffective(level);
       }
     }
   }
@@ -252,8 +303,12 @@ namespace xie
     log(LogLevel::ERROR, event);
   }
 
-  FileLogAppender::FileLogAppender(const std::string &filename) : m_filename(filename)
+  FileLogAppender::FileLogAppender(const std::string &filename, bool index) : m_filename(filename)
   {
+    if (index)
+    {
+      m_index.reset(new LogIndexWriter(filename));
+    }
     reopen();
   }
 
@@ -264,6 +319,11 @@ namespace xie
       m_filestream.close();
     }
     m_filestream.open(m_filename);
+    m_offset = 0;
+    if (m_index)
+    {
+      m_index->reset();
+    }
     return !!m_filestream; //!!非0转为1，0还是0
   }
 
@@ -271,7 +331,21 @@ namespace xie
   {
     if (level >= m_level)
     {
-      m_filestream << m_formater->format(logger, level, event);
+      std::string str = m_formater->format(logger, level, event);
+      m_filestream << str;
+      if (m_index)
+      {
+        if (m_offset == 0)
+        {
+          m_index->setPattern(m_formater->getPattern());
+        }
+        m_index->append(event->getTime(), level, logger->getName(), m_offset, str.size());
+      }
+      m_offset += str.size();
+      if (m_flush && level >= m_flushLevel)
+      {
+        m_filestream.flush();
+      }
     }
   }
 
@@ -280,6 +354,10 @@ namespace xie
     if (level >= m_level)
     {
       std::cout << m_formater->format(logger, level, event);
+      if (m_flush && level >= m_flushLevel)
+      {
+        std::cout.flush();
+      }
     }
   }
 
@@ -438,13 +516,78 @@ namespace xie
 
   LogManager::LogManager()
   {
+    for (auto &i : m_buckets)
+    {
+      i.store(nullptr, std::memory_order_relaxed);
+    }
     m_root.reset(new Logger);
     m_root->addAppender(logAppender::ptr(new StdoutLogAppender));
   }
-  Logger::ptr LogManager::getLogger(const std::string &name)
+
+  LogManager::~LogManager()
   {
-    auto it = m_loggers.find(name);
-    return it == m_loggers.end() ? m_root : it->second;
+    for (auto &i : m_buckets)
+    {
+      Node *node = i.load(std::memory_order_relaxed);
+      while (node)
+      {
+        Node *next = node->next;
+        delete node;
+        node = next;
+      }
+    }
   }
+
+  const Logger::ptr &LogManager::getLogger(const std::string &name)
+  {
+    if (name.empty() || name == m_root->getName())
+    {
+      return m_root;
+    }
+    const Logger::ptr *logger = find(name, std::hash<std::string>()(name));
+    if (logger)
+    {
+      return *logger;
+    }
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return create(name);
+  }
+
+  // 节点发布后不再修改也不释放, 返回其中logger的地址不会失效
+  const Logger::ptr *LogManager::find(const std::string &name, size_t hash) const
+  {
+    for (Node *node = m_buckets[hash % kBuckets].load(std::memory_order_acquire); node; node = node->next)
+    {
+      if (node->name == name)
+      {
+        return &node->logger;
+      }
+    }
+    return nullptr;
+  }
+
+  const Logger::ptr &LogManager::create(const std::string &name)
+  {
+    size_t hash = std::hash<std::string>()(name);
+    const Logger::ptr *found = find(name, hash);
+    if (found)
+    {
+      return *found;
+    }
+    size_t pos = name.rfind('.');
+    const Logger::ptr &parent = pos == std::string::npos || pos == 0 ? m_root : create(name.substr(0, pos));
+    Logger::ptr logger(new Logger(name));
+    logger->setParent(parent);
+
+    // 节点初始化完成后再发布, 无锁查找只会看到完整的节点
+    Node *node = new Node;
+    node->name = name;
+    node->logger = logger;
+    std::atomic<Node *> &bucket = m_buckets[hash % kBuckets];
+    node->next = bucket.load(std::memory_order_relaxed);
+    bucket.store(node, std::memory_order_release);
+    return node->logger;
+  }
+
   void LogManager::init() {}
 }
\ No newline at end of file
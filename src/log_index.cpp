@@ -0,0 +1,92 @@
+#include "log_index.h"
+#include <string.h>
+#include <functional>
+
+namespace xie
+{
+  const char *LogIndex::kMagic = "XIELOGI1";
+
+  uint64_t LogIndex::NameBit(const std::string &name)
+  {
+    size_t h = std::hash<std::string>()(name);
+    return (1ull << (h & 63)) | (1ull << ((h >> 6) & 63));
+  }
+
+  uint64_t LogIndex::NameBloom(const std::string &name)
+  {
+    uint64_t bloom = 0;
+    for (size_t pos = name.find('.'); pos != std::string::npos; pos = name.find('.', pos + 1))
+    {
+      bloom |= NameBit(name.substr(0, pos));
+    }
+    return bloom | NameBit(name);
+  }
+
+  LogIndexWriter::LogIndexWriter(const std::string &logfile, size_t block_size) : m_filename(LogIndex::IndexFile(logfile)), m_blockSize(block_size)
+  {
+    memset(&m_entry, 0, sizeof(m_entry));
+    m_ofs.open(m_filename, std::ios::binary | std::ios::trunc);
+  }
+
+  LogIndexWriter::~LogIndexWriter()
+  {
+    flush();
+  }
+
+  void LogIndexWriter::append(int64_t time, LogLevel::Level level, const std::string &name, uint64_t offset, size_t len)
+  {
+    if (!m_header)
+    {
+      uint32_t version = LogIndex::kVersion;
+      uint32_t size = m_pattern.size();
+      m_ofs.write(LogIndex::kMagic, 8);
+      m_ofs.write((const char *)&version, sizeof(version));
+      m_ofs.write((const char *)&size, sizeof(size));
+      m_ofs.write(m_pattern.data(), size);
+      m_header = true;
+    }
+    if (m_entry.records == 0)
+    {
+      m_entry.offset = offset;
+      m_entry.min_time = m_entry.max_time = time;
+    }
+    auto it = m_blooms.find(name);
+    if (it == m_blooms.end())
+    {
+      it = m_blooms.insert(std::make_pair(name, LogIndex::NameBloom(name))).first;
+    }
+    m_entry.length = offset + len - m_entry.offset;
+    m_entry.min_time = std::min(m_entry.min_time, time);
+    m_entry.max_time = std::max(m_entry.max_time, time);
+    m_entry.name_bloom |= it->second;
+    m_entry.level_mask |= 1u << level;
+    ++m_entry.records;
+    if (m_entry.length >= m_blockSize)
+    {
+      writeEntry();
+    }
+  }
+
+  void LogIndexWriter::writeEntry()
+  {
+    m_ofs.write((const char *)&m_entry, sizeof(m_entry));
+    memset(&m_entry, 0, sizeof(m_entry));
+  }
+
+  void LogIndexWriter::flush()
+  {
+    if (m_entry.records)
+    {
+      writeEntry();
+    }
+    m_ofs.flush();
+  }
+
+  void LogIndexWriter::reset()
+  {
+    memset(&m_entry, 0, sizeof(m_entry));
+    m_header = false;
+    m_ofs.close();
+    m_ofs.open(m_filename, std::ios::binary | std::ios::trunc);
+  }
+}
@@ -0,0 +1,402 @@
+#include "log_reader.h"
+#include <fcntl.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+namespace xie
+{
+  // 按日志格式解析一行的开头, 取出时间、级别和logger名; 解析失败的行视为上一条日志的续行
+  class LogReader::Parser
+  {
+  public:
+    struct Head
+    {
+      bool has_time = false;
+      bool has_level = false;
+      bool has_name = false;
+      int64_t time = 0;
+      LogLevel::Level level = LogLevel::DEBUG;
+      const char *name = nullptr;
+      size_t name_len = 0;
+    };
+
+    Parser(const std::string &pattern)
+    {
+      std::string literal;
+      for (size_t i = 0; i < pattern.size(); ++i)
+      {
+        if (pattern[i] != '%' || i + 1 >= pattern.size())
+        {
+          literal.append(1, pattern[i]);
+          continue;
+        }
+        char c = pattern[++i];
+        if (c == '%' || c == 'T' || c == 'n')
+        {
+          literal.append(1, c == 'T' ? '\t' : (c == 'n' ? '\n' : '%'));
+          continue;
+        }
+        std::string fmt;
+        if (i + 1 < pattern.size() && pattern[i + 1] == '{')
+        {
+          size_t close = pattern.find('}', i + 1);
+          if (close != std::string::npos)
+          {
+            fmt = pattern.substr(i + 2, close - i - 2);
+            i = close;
+          }
+        }
+        if (!literal.empty())
+        {
+          m_items.push_back(Item{0, literal});
+          literal.clear();
+        }
+        if (c == 'd' && fmt.empty())
+        {
+          fmt = "%Y-%m-%d %H:%M:%S";
+        }
+        m_items.push_back(Item{c, fmt});
+      }
+      if (!literal.empty())
+      {
+        m_items.push_back(Item{0, literal});
+      }
+      // 只解析到第一个换行为止
+      for (size_t i = 0; i < m_items.size(); ++i)
+      {
+        if (m_items[i].type == 0 && m_items[i].text.find('\n') != std::string::npos)
+        {
+          m_items[i].text = m_items[i].text.substr(0, m_items[i].text.find('\n'));
+          m_items.resize(i + 1);
+          break;
+        }
+      }
+    }
+
+    bool parse(const char *line, size_t len, Head &head)
+    {
+      size_t pos = 0;
+      for (size_t i = 0; i < m_items.size(); ++i)
+      {
+        const Item &item = m_items[i];
+        if (item.type == 0)
+        {
+          if (len - pos < item.text.size() || memcmp(line + pos, item.text.data(), item.text.size()) != 0)
+          {
+            return false;
+          }
+          pos += item.text.size();
+          continue;
+        }
+        if (item.type == 'm')
+        {
+          break;
+        }
+        size_t end = len;
+        if (i + 1 < m_items.size())
+        {
+          const Item &next = m_items[i + 1];
+          if (next.type != 0)
+          {
+            // 两个字段之间没有分隔符, 无法继续解析
+            break;
+          }
+          if (!next.text.empty())
+          {
+            const char *p = (const char *)memmem(line + pos, len - pos, next.text.data(), next.text.size());
+            if (!p)
+            {
+              return false;
+            }
+            end = p - line;
+          }
+        }
+        if (!parseField(item, line + pos, end - pos, head))
+        {
+          return false;
+        }
+        pos = end;
+      }
+      return true;
+    }
+
+  private:
+    struct Item
+    {
+      char type; // 0为字面量, 否则为格式字符
+      std::string text;
+    };
+
+    bool parseField(const Item &item, const char *value, size_t len, Head &head)
+    {
+      switch (item.type)
+      {
+      case 'd':
+      {
+        // 同一秒内的日志时间字符串相同, 缓存上一次的解析结果
+        if (len != m_lastTime.size() || memcmp(value, m_lastTime.data(), len) != 0)
+        {
+          m_lastTime.assign(value, len);
+          struct tm tm;
+          memset(&tm, 0, sizeof(tm));
+          const char *rt = strptime(m_lastTime.c_str(), item.text.c_str(), &tm);
+          if (!rt || *rt)
+          {
+            m_lastTime.clear();
+            return false;
+          }
+          tm.tm_isdst = -1;
+          m_lastValue = mktime(&tm);
+        }
+        head.has_time = true;
+        head.time = m_lastValue;
+        return true;
+      }
+      case 'p':
+      {
+        for (int l = LogLevel::DEBUG; l <= LogLevel::FATAL; ++l)
+        {
+          const char *name = LogLevel::toString((LogLevel::Level)l);
+          if (strlen(name) == len && memcmp(name, value, len) == 0)
+          {
+            head.has_level = true;
+            head.level = (LogLevel::Level)l;
+            return true;
+          }
+        }
+        return false;
+      }
+      case 'c':
+        head.has_name = true;
+        head.name = value;
+        head.name_len = len;
+        return true;
+      default:
+        return true;
+      }
+    }
+
+  private:
+    std::vector<Item> m_items;
+    std::string m_lastTime;
+    int64_t m_lastValue = 0;
+  };
+
+  LogReader::LogReader(const std::string &logfile) : m_filename(logfile), m_pattern("%d%T%t%T%F%T[%p]%T[%c]%T%f:%l%T%m%n")
+  {
+  }
+
+  LogReader::~LogReader()
+  {
+    if (m_data)
+    {
+      munmap((void *)m_data, m_size);
+    }
+    if (m_fd >= 0)
+    {
+      close(m_fd);
+    }
+  }
+
+  bool LogReader::open()
+  {
+    m_fd = ::open(m_filename.c_str(), O_RDONLY | O_CLOEXEC);
+    if (m_fd < 0)
+    {
+      return false;
+    }
+    struct stat st;
+    if (fstat(m_fd, &st) != 0)
+    {
+      return false;
+    }
+    m_size = st.st_size;
+    if (m_size)
+    {
+      void *p = mmap(nullptr, m_size, PROT_READ, MAP_SHARED, m_fd, 0);
+      if (p == MAP_FAILED)
+      {
+        return false;
+      }
+      m_data = (const char *)p;
+    }
+    m_hasIndex = loadIndex();
+    return true;
+  }
+
+  bool LogReader::loadIndex()
+  {
+    std::ifstream ifs(LogIndex::IndexFile(m_filename), std::ios::binary);
+    char magic[8];
+    uint32_t version = 0;
+    uint32_t size = 0;
+    if (!ifs.read(magic, 8) || memcmp(magic, LogIndex::kMagic, 8) != 0 || !ifs.read((char *)&version, sizeof(version)) || version != LogIndex::kVersion || !ifs.read((char *)&size, sizeof(size)))
+    {
+      return false;
+    }
+    std::string pattern(size, '\0');
+    if (!ifs.read(&pattern[0], size))
+    {
+      return false;
+    }
+    if (!pattern.empty())
+    {
+      m_pattern = pattern;
+    }
+    LogIndexEntry entry;
+    while (ifs.read((char *)&entry, sizeof(entry)))
+    {
+      // 日志可能还没刷到磁盘, 超出文件大小的块不使用
+      if (entry.offset + entry.length > m_size)
+      {
+        break;
+      }
+      m_entries.push_back(entry);
+    }
+    return true;
+  }
+
+  std::vector<LogReader::Record> LogReader::query(const Query &q, Stats *stats) const
+  {
+    std::vector<Task> tasks;
+    uint64_t nameBit = q.logger.empty() ? 0 : LogIndex::NameBit(q.logger);
+    size_t n = m_entries.size();
+
+    // 块内时间不严格有序, 用前缀最大值和后缀最小值得到单调序列后二分
+    std::vector<int64_t> prefixMax(n);
+    std::vector<int64_t> suffixMin(n);
+    for (size_t i = 0; i < n; ++i)
+    {
+      prefixMax[i] = i ? std::max(prefixMax[i - 1], m_entries[i].max_time) : m_entries[i].max_time;
+    }
+    for (size_t i = n; i > 0; --i)
+    {
+      suffixMin[i - 1] = i < n ? std::min(suffixMin[i], m_entries[i - 1].min_time) : m_entries[i - 1].min_time;
+    }
+    size_t lo = std::lower_bound(prefixMax.begin(), prefixMax.end(), q.begin) - prefixMax.begin();
+    size_t hi = std::upper_bound(suffixMin.begin(), suffixMin.end(), q.end) - suffixMin.begin();
+    for (size_t i = lo; i < hi; ++i)
+    {
+      const LogIndexEntry &e = m_entries[i];
+      if (e.max_time < q.begin || e.min_time > q.end || !(e.level_mask & q.level_mask) || (e.name_bloom & nameBit) != nameBit)
+      {
+        continue;
+      }
+      bool copy = e.min_time >= q.begin && e.max_time <= q.end && !(e.level_mask & ~q.level_mask) && q.logger.empty();
+      tasks.push_back(Task{e.offset, e.length, e.records, copy});
+    }
+    // 最后一个索引块之后的数据还没有索引, 需要逐行扫描
+    uint64_t indexed = n ? m_entries.back().offset + m_entries.back().length : 0;
+    if (m_size > indexed)
+    {
+      tasks.push_back(Task{indexed, m_size - indexed, 0, false});
+    }
+
+    size_t threads = q.threads ? q.threads : std::max(1u, std::thread::hardware_concurrency());
+    threads = std::min(threads, tasks.size());
+    std::vector<std::vector<Record>> results(tasks.size());
+    std::vector<size_t> counts(tasks.size(), 0);
+    std::atomic<size_t> next{0};
+    auto worker = [&]()
+    {
+      Parser parser(m_pattern);
+      for (size_t i = next.fetch_add(1); i < tasks.size(); i = next.fetch_add(1))
+      {
+        scan(tasks[i], q, parser, results[i], counts[i]);
+      }
+    };
+    std::vector<std::thread> pool;
+    for (size_t i = 1; i < threads; ++i)
+    {
+      pool.push_back(std::thread(worker));
+    }
+    if (threads)
+    {
+      worker();
+    }
+    for (auto &i : pool)
+    {
+      i.join();
+    }
+
+    std::vector<Record> out;
+    for (auto &r : results)
+    {
+      for (auto &i : r)
+      {
+        if (!out.empty() && out.back().data + out.back().size == i.data)
+        {
+          out.back().size += i.size;
+        }
+        else
+        {
+          out.push_back(i);
+        }
+      }
+    }
+    if (stats)
+    {
+      stats->blocks = n;
+      for (size_t i = 0; i < tasks.size(); ++i)
+      {
+        ++(tasks[i].copy ? stats->blocks_copied : stats->blocks_scanned);
+        stats->bytes_scanned += tasks[i].copy ? 0 : tasks[i].length;
+        stats->records += counts[i];
+      }
+    }
+    return out;
+  }
+
+  void LogReader::scan(const Task &task, const Query &q, Parser &parser, std::vector<Record> &out, size_t &records) const
+  {
+    const char *begin = m_data + task.offset;
+    const char *end = begin + task.length;
+    if (task.copy)
+    {
+      out.push_back(Record{begin, (size_t)task.length});
+      records = task.records;
+      return;
+    }
+    const char *recBegin = nullptr; // 当前日志的开头
+    bool match = false;
+    auto finish = [&](const char *recEnd)
+    {
+      if (recBegin && match)
+      {
+        if (!out.empty() && out.back().data + out.back().size == recBegin)
+        {
+          out.back().size += recEnd - recBegin;
+        }
+        else
+        {
+          out.push_back(Record{recBegin, (size_t)(recEnd - recBegin)});
+        }
+        ++records;
+      }
+    };
+    for (const char *line = begin; line < end;)
+    {
+      const char *nl = (const char *)memchr(line, '\n', end - line);
+      const char *lineEnd = nl ? nl : end;
+      Parser::Head head;
+      if (parser.parse(line, lineEnd - line, head))
+      {
+        finish(line);
+        recBegin = line;
+        match = (!head.has_time || (head.time >= q.begin && head.time <= q.end)) && (!head.has_level || (q.level_mask & (1u << head.level)));
+        if (match && !q.logger.empty() && head.has_name)
+        {
+          match = head.name_len >= q.logger.size() && memcmp(head.name, q.logger.data(), q.logger.size()) == 0 && (head.name_len == q.logger.size() || head.name[q.logger.size()] == '.');
+        }
+      }
+      line = nl ? nl + 1 : end;
+    }
+    finish(end);
+  }
+}
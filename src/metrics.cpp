@@ -0,0 +1,263 @@
+#include "metrics.h"
+#include <sstream>
+#include <algorithm>
+#include <sched.h>
+#include <unistd.h>
+
+namespace xie
+{
+  size_t GetMetricShardCount()
+  {
+    // 按可配置的CPU数而不是在线CPU数, sched_getcpu()返回的编号不会越界
+    static size_t s_count = std::max<long>(sysconf(_SC_NPROCESSORS_CONF), 1);
+    return s_count;
+  }
+
+  size_t GetMetricShard()
+  {
+    int cpu = sched_getcpu();
+    if (cpu >= 0)
+    {
+      return (size_t)cpu % GetMetricShardCount();
+    }
+    static std::atomic<size_t> s_next{0};
+    static thread_local size_t t_shard = s_next.fetch_add(1, std::memory_order_relaxed) % GetMetricShardCount();
+    return t_shard;
+  }
+
+  static std::string exportName(const std::string &name)
+  {
+    std::string rt = name;
+    for (auto &c : rt)
+    {
+      if (c == '.')
+      {
+        c = '_';
+      }
+    }
+    return rt;
+  }
+
+  static void dumpHeader(std::ostream &os, const MetricBase &m, const std::string &name)
+  {
+    if (!m.GetDescription().empty())
+    {
+      os << "# HELP " << name << " " << m.GetDescription() << "\n";
+    }
+    os << "# TYPE " << name << " " << m.GetType() << "\n";
+  }
+
+  uint64_t Counter::GetValue() const
+  {
+    uint64_t v = 0;
+    for (size_t i = 0; i < GetMetricShardCount(); ++i)
+    {
+      v += m_shards[i].value.load(std::memory_order_relaxed);
+    }
+    return v;
+  }
+
+  void Counter::dump(std::ostream &os) const
+  {
+    std::string name = exportName(m_name);
+    dumpHeader(os, *this, name);
+    os << name << " " << GetValue() << "\n";
+  }
+
+  void Gauge::dump(std::ostream &os) const
+  {
+    std::string name = exportName(m_name);
+    dumpHeader(os, *this, name);
+    os << name << " " << GetValue() << "\n";
+  }
+
+  Histogram::Histogram(const std::string &name, const std::string &description) : MetricBase(name, description)
+  {
+    m_shards.reset(new Shard[GetMetricShardCount()]);
+    for (size_t i = 0; i < GetMetricShardCount(); ++i)
+    {
+      m_shards[i].sum.store(0, std::memory_order_relaxed);
+      for (auto &b : m_shards[i].buckets)
+      {
+        b.store(0, std::memory_order_relaxed);
+      }
+    }
+  }
+
+  uint64_t Histogram::BucketUpper(size_t idx)
+  {
+    if (idx < 2 * kSubCount)
+    {
+      return idx;
+    }
+    size_t e = (idx - 2 * kSubCount) / kSubCount + kSubBits + 1;
+    uint64_t sub = (idx - 2 * kSubCount) % kSubCount;
+    uint64_t width = 1ull << (e - kSubBits);
+    return ((kSubCount + sub) << (e - kSubBits)) + (width - 1);
+  }
+
+  Histogram::Snapshot Histogram::GetSnapshot() const
+  {
+    Snapshot s;
+    s.buckets.resize(kBuckets, 0);
+    for (size_t i = 0; i < GetMetricShardCount(); ++i)
+    {
+      s.sum += m_shards[i].sum.load(std::memory_order_relaxed);
+      for (size_t b = 0; b < kBuckets; ++b)
+      {
+        uint64_t n = m_shards[i].buckets[b].load(std::memory_order_relaxed);
+        s.buckets[b] += n;
+        s.count += n;
+      }
+    }
+    return s;
+  }
+
+  uint64_t Histogram::Snapshot::percentile(double p) const
+  {
+    if (count == 0)
+    {
+      return 0;
+    }
+    uint64_t rank = (uint64_t)(p / 100.0 * count + 0.5);
+    rank = rank == 0 ? 1 : (rank > count ? count : rank);
+    uint64_t seen = 0;
+    for (size_t i = 0; i < buckets.size(); ++i)
+    {
+      seen += buckets[i];
+      if (seen >= rank)
+      {
+        return BucketUpper(i);
+      }
+    }
+    return max();
+  }
+
+  uint64_t Histogram::Snapshot::max() const
+  {
+    for (size_t i = buckets.size(); i > 0; --i)
+    {
+      if (buckets[i - 1])
+      {
+        return BucketUpper(i - 1);
+      }
+    }
+    return 0;
+  }
+
+  void Histogram::dump(std::ostream &os) const
+  {
+    std::string name = exportName(m_name);
+    Snapshot s = GetSnapshot();
+    dumpHeader(os, *this, name);
+    static const double s_quantiles[] = {50, 90, 99, 99.9};
+    for (auto &q : s_quantiles)
+    {
+      os << name << "{quantile=\"" << q / 100 << "\"} " << s.percentile(q) << "\n";
+    }
+    os << name << "_sum " << s.sum << "\n";
+    os << name << "_count " << s.count << "\n";
+  }
+
+  void Metrics::Visit(std::function<void(MetricBase::ptr)> cb)
+  {
+    // 先复制一份, 回调中可以再Lookup
+    std::vector<MetricBase::ptr> all;
+    {
+      std::lock_guard<std::mutex> lock(GetMutex());
+      for (auto &i : GetDatas())
+      {
+        all.push_back(i.second);
+      }
+    }
+    for (auto &i : all)
+    {
+      cb(i);
+    }
+  }
+
+  std::string Metrics::ToText()
+  {
+    std::stringstream ss;
+    Visit([&ss](MetricBase::ptr m)
+          { m->dump(ss); });
+    return ss.str();
+  }
+
+  MetricsDumper::MetricsDumper(Logger::ptr logger, uint32_t interval_ms) : m_logger(logger), m_interval(interval_ms)
+  {
+  }
+
+  MetricsDumper::~MetricsDumper()
+  {
+    stop();
+  }
+
+  void MetricsDumper::setHook(ExportHook hook)
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_hook = hook;
+  }
+
+  void MetricsDumper::start()
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_stop)
+    {
+      return;
+    }
+    m_stop = false;
+    m_thread = std::thread(&MetricsDumper::run, this);
+  }
+
+  void MetricsDumper::stop()
+  {
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      if (m_stop)
+      {
+        return;
+      }
+      m_stop = true;
+    }
+    m_cond.notify_one();
+    if (m_thread.joinable())
+    {
+      m_thread.join();
+    }
+  }
+
+  void MetricsDumper::dump()
+  {
+    std::string text = Metrics::ToText();
+    if (m_logger)
+    {
+      XIE_LOG_INFO(m_logger) << "metrics:\n"
+                             << text;
+    }
+    ExportHook hook;
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      hook = m_hook;
+    }
+    if (hook)
+    {
+      hook(text);
+    }
+  }
+
+  void MetricsDumper::run()
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (!m_stop)
+    {
+      m_cond.wait_for(lock, std::chrono::milliseconds(m_interval));
+      if (!m_stop)
+      {
+        lock.unlock();
+        dump();
+        lock.lock();
+      }
+    }
+  }
+}
@@ -0,0 +1,669 @@
+#include "rpc.h"
+#include <errno.h>
+#include <poll.h>
+#include <string.h>
+#include <time.h>
+#include <endian.h>
+#include <limits.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/eventfd.h>
+#include <algorithm>
+
+namespace xie
+{
+  static uint64_t nowUS()
+  {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000ull + ts.tv_nsec / 1000;
+  }
+
+  static uint64_t deadlineOf(uint32_t timeout_ms)
+  {
+    return timeout_ms ? nowUS() + timeout_ms * 1000ull : 0;
+  }
+
+  static void setNoDelay(int fd)
+  {
+    int on = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+  }
+
+  // 从fd读出所有完整的帧交给cb, buf保存不完整的尾部; 返回false表示连接关闭或数据非法
+  template <class CB>
+  static bool readFrames(int fd, std::string &buf, CB cb)
+  {
+    char tmp[64 * 1024];
+    ssize_t n = recv(fd, tmp, sizeof(tmp), 0);
+    if (n < 0 && errno == EINTR)
+    {
+      return true;
+    }
+    if (n <= 0)
+    {
+      return false;
+    }
+    buf.append(tmp, n);
+    size_t off = 0;
+    int64_t rt;
+    RpcFrame frame;
+    while ((rt = RpcFrame::Decode(buf.data() + off, buf.size() - off, frame)) > 0)
+    {
+      off += rt;
+      cb(frame);
+    }
+    buf.erase(0, off);
+    return rt >= 0;
+  }
+
+  const char *RpcStatus::toString(RpcStatus::Code code)
+  {
+    switch (code)
+    {
+#define XX(name)          \
+  case RpcStatus::name:   \
+    return #name;         \
+    break;
+      XX(OK);
+      XX(NOT_FOUND);
+      XX(TIMEOUT);
+      XX(ERROR);
+      XX(CLOSED);
+#undef XX
+    default:
+      return "UNKNOW";
+    }
+    return "UNKNOW";
+  }
+
+  void RpcFrame::encode(std::string &out) const
+  {
+    size_t size = kHeaderSize + method.size() + payload.size();
+    out.resize(size);
+    char *p = &out[0];
+    uint32_t length = htobe32(size - 4);
+    uint16_t method_len = htobe16(method.size());
+    uint64_t be_id = htobe64(id);
+    uint32_t timeout = htobe32(timeout_ms);
+    memcpy(p, &length, 4);
+    p[4] = type;
+    p[5] = status;
+    memcpy(p + 6, &method_len, 2);
+    memcpy(p + 8, &be_id, 8);
+    memcpy(p + 16, &timeout, 4);
+    memcpy(p + kHeaderSize, method.data(), method.size());
+    memcpy(p + kHeaderSize + method.size(), payload.data(), payload.size());
+  }
+
+  int64_t RpcFrame::Decode(const char *data, size_t len, RpcFrame &frame)
+  {
+    if (len < 4)
+    {
+      return 0;
+    }
+    uint32_t length;
+    memcpy(&length, data, 4);
+    length = be32toh(length);
+    if (length < kHeaderSize - 4 || length > kMaxSize)
+    {
+      return -1;
+    }
+    if (len < length + 4)
+    {
+      return 0;
+    }
+    uint16_t method_len;
+    memcpy(&method_len, data + 6, 2);
+    method_len = be16toh(method_len);
+    if (method_len > length + 4 - kHeaderSize)
+    {
+      return -1;
+    }
+    frame.type = data[4];
+    frame.status = data[5];
+    memcpy(&frame.id, data + 8, 8);
+    frame.id = be64toh(frame.id);
+    memcpy(&frame.timeout_ms, data + 16, 4);
+    frame.timeout_ms = be32toh(frame.timeout_ms);
+    frame.method.assign(data + kHeaderSize, method_len);
+    frame.payload.assign(data + kHeaderSize + method_len, length + 4 - kHeaderSize - method_len);
+    return length + 4;
+  }
+
+  bool RpcWriter::send(std::string &&frame)
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (m_error)
+    {
+      return false;
+    }
+    m_queue.push_back(std::move(frame));
+    if (m_writing || m_cork > 0)
+    {
+      return true;
+    }
+    return flush(lock);
+  }
+
+  void RpcWriter::cork()
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    ++m_cork;
+  }
+
+  bool RpcWriter::uncork()
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (--m_cork > 0 || m_writing || m_queue.empty())
+    {
+      return !m_error;
+    }
+    return flush(lock);
+  }
+
+  // 写出期间其他线程追加的帧由当前写者在下一轮一并写出
+  bool RpcWriter::flush(std::unique_lock<std::mutex> &lock)
+  {
+    m_writing = true;
+    std::vector<std::string> batch;
+    std::vector<struct iovec> iov;
+    while (!m_queue.empty() && !m_error)
+    {
+      batch.swap(m_queue);
+      lock.unlock();
+      m_frames.fetch_add(batch.size(), std::memory_order_relaxed);
+      bool ok = true;
+      size_t i = 0;
+      size_t skip = 0; // batch[i]中已写出的字节数
+      while (ok && i < batch.size())
+      {
+        iov.clear();
+        for (size_t j = i; j < batch.size() && iov.size() < IOV_MAX; ++j)
+        {
+          size_t off = j == i ? skip : 0;
+          iov.push_back({(void *)(batch[j].data() + off), batch[j].size() - off});
+        }
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = iov.data();
+        msg.msg_iovlen = iov.size();
+        ssize_t n = sendmsg(m_fd, &msg, MSG_NOSIGNAL);
+        if (n < 0)
+        {
+          ok = errno == EINTR;
+          continue;
+        }
+        m_writes.fetch_add(1, std::memory_order_relaxed);
+        size_t left = n;
+        while (i < batch.size() && left >= batch[i].size() - skip)
+        {
+          left -= batch[i].size() - skip;
+          skip = 0;
+          ++i;
+        }
+        skip += left;
+      }
+      batch.clear();
+      lock.lock();
+      if (!ok)
+      {
+        // 写失败后连接不可再用, 关闭socket让读端立即感知并让等待中的请求失败
+        m_error = true;
+        m_queue.clear();
+        shutdown(m_fd, SHUT_RDWR);
+      }
+    }
+    m_writing = false;
+    return !m_error;
+  }
+
+  struct RpcServer::Connection
+  {
+    Connection(int fd_) : fd(fd_), writer(new RpcWriter(fd_)) {}
+    ~Connection() { ::close(fd); }
+    int fd;
+    RpcWriter::ptr writer;
+    std::thread thread;
+    std::atomic<bool> done{false};
+  };
+
+  RpcServer::RpcServer(size_t workers)
+      : m_workerCount(workers ? workers : 1)
+  {
+  }
+
+  RpcServer::~RpcServer()
+  {
+    stop();
+    if (m_listen >= 0)
+    {
+      ::close(m_listen);
+    }
+  }
+
+  void RpcServer::registerHandler(const std::string &method, Handler handler)
+  {
+    m_handlers[method] = handler;
+  }
+
+  bool RpcServer::bind(const std::string &ip, uint16_t port)
+  {
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    if (inet_pton(AF_INET, ip.c_str(), &addr.sin_addr) != 1)
+    {
+      return false;
+    }
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+    {
+      return false;
+    }
+    int on = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    socklen_t len = sizeof(addr);
+    if (::bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, 1024) < 0 || getsockname(fd, (struct sockaddr *)&addr, &len) < 0)
+    {
+      ::close(fd);
+      return false;
+    }
+    if (m_listen >= 0)
+    {
+      ::close(m_listen);
+    }
+    m_listen = fd;
+    m_port = ntohs(addr.sin_port);
+    return true;
+  }
+
+  void RpcServer::start()
+  {
+    if (m_listen < 0 || !m_stop.exchange(false))
+    {
+      return;
+    }
+    for (size_t i = 0; i < m_workerCount; ++i)
+    {
+      m_workers.push_back(std::thread(&RpcServer::workLoop, this));
+    }
+    m_acceptThread = std::thread(&RpcServer::acceptLoop, this);
+  }
+
+  void RpcServer::stop()
+  {
+    if (m_stop.exchange(true))
+    {
+      return;
+    }
+    shutdown(m_listen, SHUT_RDWR);
+    m_acceptThread.join();
+    {
+      std::lock_guard<std::mutex> lock(m_connMutex);
+      for (auto &i : m_conns)
+      {
+        shutdown(i->fd, SHUT_RDWR);
+        i->thread.join();
+      }
+      m_conns.clear();
+    }
+    m_cond.notify_all();
+    for (auto &i : m_workers)
+    {
+      i.join();
+    }
+    m_workers.clear();
+    m_tasks.clear();
+    // 监听socket已被shutdown, 再次start前需要重新bind
+    ::close(m_listen);
+    m_listen = -1;
+  }
+
+  void RpcServer::acceptLoop()
+  {
+    while (!m_stop)
+    {
+      int fd = accept4(m_listen, nullptr, nullptr, SOCK_CLOEXEC);
+      if (fd < 0)
+      {
+        if (errno == EINTR || errno == ECONNABORTED)
+        {
+          continue;
+        }
+        break;
+      }
+      setNoDelay(fd);
+      std::shared_ptr<Connection> conn(new Connection(fd));
+      std::lock_guard<std::mutex> lock(m_connMutex);
+      // 顺便回收已经断开的连接
+      for (auto it = m_conns.begin(); it != m_conns.end();)
+      {
+        if ((*it)->done)
+        {
+          (*it)->thread.join();
+          it = m_conns.erase(it);
+        }
+        else
+        {
+          ++it;
+        }
+      }
+      conn->thread = std::thread(&RpcServer::readLoop, this, conn);
+      m_conns.push_back(conn);
+    }
+  }
+
+  void RpcServer::readLoop(std::shared_ptr<Connection> conn)
+  {
+    std::string buf;
+    std::vector<Task> tasks;
+    auto onFrame = [&tasks, &conn](RpcFrame &frame)
+    {
+      if (frame.type == RpcFrame::REQUEST)
+      {
+        uint64_t deadline = deadlineOf(frame.timeout_ms);
+        tasks.push_back(Task{conn, std::move(frame), deadline});
+      }
+    };
+    while (readFrames(conn->fd, buf, onFrame))
+    {
+      if (tasks.empty())
+      {
+        continue;
+      }
+      {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (auto &i : tasks)
+        {
+          m_tasks.push_back(std::move(i));
+        }
+      }
+      if (tasks.size() == 1)
+      {
+        m_cond.notify_one();
+      }
+      else
+      {
+        m_cond.notify_all();
+      }
+      tasks.clear();
+    }
+    shutdown(conn->fd, SHUT_RDWR);
+    conn->done = true;
+  }
+
+  void RpcServer::workLoop()
+  {
+    while (true)
+    {
+      Task task;
+      {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_cond.wait(lock, [this]()
+                    { return m_stop || !m_tasks.empty(); });
+        if (m_stop)
+        {
+          return;
+        }
+        task = std::move(m_tasks.front());
+        m_tasks.pop_front();
+      }
+      process(task);
+    }
+  }
+
+  void RpcServer::process(Task &task)
+  {
+    RpcFrame rsp;
+    rsp.type = RpcFrame::RESPONSE;
+    rsp.id = task.frame.id;
+    auto it = m_handlers.find(task.frame.method);
+    if (it == m_handlers.end())
+    {
+      rsp.status = RpcStatus::NOT_FOUND;
+    }
+    else if (task.deadline_us && nowUS() >= task.deadline_us)
+    {
+      // 排队期间已经超时, 客户端不再等待结果, 不必执行
+      rsp.status = RpcStatus::TIMEOUT;
+    }
+    else if (!it->second(task.frame.payload, rsp.payload))
+    {
+      rsp.status = RpcStatus::ERROR;
+      rsp.payload.clear();
+    }
+    std::string out;
+    rsp.encode(out);
+    task.conn->writer->send(std::move(out));
+  }
+
+  RpcClient::RpcClient()
+  {
+    m_wakeup = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  }
+
+  RpcClient::~RpcClient()
+  {
+    close();
+    if (m_wakeup >= 0)
+    {
+      ::close(m_wakeup);
+    }
+  }
+
+  bool RpcClient::connect(const std::string &ip, uint16_t port)
+  {
+    close();
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    if (inet_pton(AF_INET, ip.c_str(), &addr.sin_addr) != 1)
+    {
+      return false;
+    }
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+    {
+      return false;
+    }
+    if (::connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+    {
+      ::close(fd);
+      return false;
+    }
+    setNoDelay(fd);
+    m_fd = fd;
+    m_writer.reset(new RpcWriter(fd));
+    m_closed = false;
+    m_reader = std::thread(&RpcClient::readLoop, this);
+    return true;
+  }
+
+  // 调用方需保证close()不与call()并发
+  void RpcClient::close()
+  {
+    if (m_fd < 0)
+    {
+      return;
+    }
+    shutdown(m_fd, SHUT_RDWR);
+    m_reader.join();
+    ::close(m_fd);
+    m_fd = -1;
+  }
+
+  std::future<RpcClient::Result> RpcClient::call(const std::string &method, const std::string &request, uint32_t timeout_ms)
+  {
+    std::shared_ptr<std::promise<Result>> promise(new std::promise<Result>());
+    call(
+        method, request, [promise](Result &&result)
+        { promise->set_value(std::move(result)); },
+        timeout_ms);
+    return promise->get_future();
+  }
+
+  void RpcClient::call(const std::string &method, const std::string &request, Callback cb, uint32_t timeout_ms)
+  {
+    RpcFrame frame;
+    frame.id = m_nextId.fetch_add(1, std::memory_order_relaxed);
+    frame.timeout_ms = timeout_ms;
+    frame.method = method;
+    frame.payload = request;
+    uint64_t deadline = deadlineOf(timeout_ms);
+    bool wakeup = false;
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      if (m_closed)
+      {
+        lock.unlock();
+        cb(Result{RpcStatus::CLOSED, ""});
+        return;
+      }
+      m_pending[frame.id] = Pending{std::move(cb), deadline};
+      if (deadline)
+      {
+        // 成为最早的截止时间时唤醒读线程重新计算poll超时
+        auto it = m_deadlines.insert(std::make_pair(deadline, frame.id));
+        wakeup = it == m_deadlines.begin();
+      }
+    }
+    if (wakeup)
+    {
+      uint64_t one = 1;
+      ssize_t n = write(m_wakeup, &one, sizeof(one));
+      (void)n;
+    }
+    std::string out;
+    frame.encode(out);
+    if (!m_writer->send(std::move(out)))
+    {
+      complete(frame.id, Result{RpcStatus::CLOSED, ""});
+    }
+  }
+
+  void RpcClient::readLoop()
+  {
+    std::string buf;
+    auto onFrame = [this](RpcFrame &frame)
+    {
+      if (frame.type == RpcFrame::RESPONSE)
+      {
+        complete(frame.id, Result{(RpcStatus::Code)frame.status, std::move(frame.payload)});
+      }
+    };
+    struct pollfd pfds[2];
+    pfds[0].fd = m_fd;
+    pfds[0].events = POLLIN;
+    pfds[1].fd = m_wakeup;
+    pfds[1].events = POLLIN;
+    while (true)
+    {
+      // 没有带超时的请求时一直等待, 否则等到最早的截止时间
+      int timeout = -1;
+      {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_deadlines.empty())
+        {
+          uint64_t now = nowUS();
+          uint64_t deadline = m_deadlines.begin()->first;
+          timeout = deadline <= now ? 0 : (int)std::min<uint64_t>((deadline - now + 999) / 1000, INT_MAX);
+        }
+      }
+      int rt = poll(pfds, 2, timeout);
+      if (rt < 0 && errno != EINTR)
+      {
+        break;
+      }
+      if (rt > 0 && pfds[1].revents)
+      {
+        uint64_t v;
+        ssize_t n = read(m_wakeup, &v, sizeof(v));
+        (void)n;
+      }
+      if (rt > 0 && pfds[0].revents)
+      {
+        // 回调中发出的新请求暂存起来, 处理完这一批响应后合并写出
+        m_writer->cork();
+        bool alive = readFrames(m_fd, buf, onFrame);
+        m_writer->uncork();
+        if (!alive)
+        {
+          break;
+        }
+      }
+      expire();
+    }
+    failAll();
+  }
+
+  void RpcClient::complete(uint64_t id, Result &&result)
+  {
+    Callback cb;
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      auto it = m_pending.find(id);
+      if (it == m_pending.end())
+      {
+        // 已经超时的请求, 丢弃迟到的响应
+        return;
+      }
+      cb = std::move(it->second.cb);
+      if (it->second.deadline_us)
+      {
+        auto range = m_deadlines.equal_range(it->second.deadline_us);
+        for (auto d = range.first; d != range.second; ++d)
+        {
+          if (d->second == id)
+          {
+            m_deadlines.erase(d);
+            break;
+          }
+        }
+      }
+      m_pending.erase(it);
+    }
+    cb(std::move(result));
+  }
+
+  void RpcClient::expire()
+  {
+    std::vector<Callback> expired;
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      uint64_t now = nowUS();
+      auto it = m_deadlines.begin();
+      for (; it != m_deadlines.end() && it->first <= now; ++it)
+      {
+        auto p = m_pending.find(it->second);
+        expired.push_back(std::move(p->second.cb));
+        m_pending.erase(p);
+      }
+      m_deadlines.erase(m_deadlines.begin(), it);
+    }
+    for (auto &i : expired)
+    {
+      i(Result{RpcStatus::TIMEOUT, ""});
+    }
+  }
+
+  void RpcClient::failAll()
+  {
+    std::unordered_map<uint64_t, Pending> pending;
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_closed = true;
+      pending.swap(m_pending);
+      m_deadlines.clear();
+    }
+    for (auto &i : pending)
+    {
+      i.second.cb(Result{RpcStatus::CLOSED, ""});
+    }
+  }
+}
@@ -0,0 +1,572 @@
+#include "static_file.h"
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <string.h>
+#include <stdlib.h>
+#include <strings.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+
+namespace xie
+{
+  static const char *contentType(const std::string &path)
+  {
+    static const std::unordered_map<std::string, const char *> s_types = {
+        {"html", "text/html; charset=utf-8"},
+        {"htm", "text/html; charset=utf-8"},
+        {"css", "text/css"},
+        {"js", "application/javascript"},
+        {"json", "application/json"},
+        {"txt", "text/plain; charset=utf-8"},
+        {"xml", "application/xml"},
+        {"png", "image/png"},
+        {"jpg", "image/jpeg"},
+        {"jpeg", "image/jpeg"},
+        {"gif", "image/gif"},
+        {"svg", "image/svg+xml"},
+        {"ico", "image/x-icon"},
+        {"pdf", "application/pdf"},
+        {"zip", "application/zip"},
+        {"gz", "application/gzip"},
+        {"mp4", "video/mp4"},
+        {"wasm", "application/wasm"}};
+    size_t dot = path.rfind('.');
+    size_t slash = path.rfind('/');
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+    {
+      return "application/octet-stream";
+    }
+    std::string ext = path.substr(dot + 1);
+    for (auto &c : ext)
+    {
+      c = tolower(c);
+    }
+    auto it = s_types.find(ext);
+    return it == s_types.end() ? "application/octet-stream" : it->second;
+  }
+
+  static std::string dirName(const std::string &path)
+  {
+    size_t pos = path.rfind('/');
+    return pos == std::string::npos ? "." : (pos == 0 ? "/" : path.substr(0, pos));
+  }
+
+  static bool waitWritable(int fd)
+  {
+    struct pollfd pfd;
+    pfd.fd = fd;
+    pfd.events = POLLOUT;
+    pfd.revents = 0;
+    int rt;
+    do
+    {
+      rt = poll(&pfd, 1, -1);
+    } while (rt < 0 && errno == EINTR);
+    return rt > 0 && !(pfd.revents & (POLLERR | POLLHUP | POLLNVAL));
+  }
+
+  bool WriteAll(int fd, const char *data, size_t len, int flags)
+  {
+    while (len > 0)
+    {
+      ssize_t n = send(fd, data, len, flags | MSG_NOSIGNAL);
+      if (n < 0)
+      {
+        if (errno == EINTR)
+        {
+          continue;
+        }
+        if ((errno == EAGAIN || errno == EWOULDBLOCK) && waitWritable(fd))
+        {
+          continue;
+        }
+        return false;
+      }
+      data += n;
+      len -= n;
+    }
+    return true;
+  }
+
+  bool SendFile(int out_fd, int in_fd, uint64_t offset, uint64_t len)
+  {
+    off_t off = offset;
+    while (len > 0)
+    {
+      ssize_t n = sendfile(out_fd, in_fd, &off, len > (1u << 30) ? (1u << 30) : len);
+      if (n < 0)
+      {
+        if (errno == EINTR)
+        {
+          continue;
+        }
+        if ((errno == EAGAIN || errno == EWOULDBLOCK) && waitWritable(out_fd))
+        {
+          continue;
+        }
+        return false;
+      }
+      if (n == 0)
+      {
+        // 文件在发送过程中被截断
+        return false;
+      }
+      len -= n;
+    }
+    return true;
+  }
+
+  FileCache::Entry::~Entry()
+  {
+    if (fd >= 0)
+    {
+      close(fd);
+    }
+  }
+
+  FileCache::FileCache(size_t capacity) : m_capacity(capacity / kShards ? capacity / kShards : 1)
+  {
+    m_inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    m_wakeup = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (m_inotify >= 0 && m_wakeup >= 0)
+    {
+      m_thread = std::thread(&FileCache::eventLoop, this);
+    }
+    else if (m_inotify >= 0)
+    {
+      close(m_inotify);
+      m_inotify = -1;
+    }
+  }
+
+  FileCache::~FileCache()
+  {
+    if (m_thread.joinable())
+    {
+      uint64_t one = 1;
+      ssize_t rt = write(m_wakeup, &one, sizeof(one));
+      (void)rt;
+      m_thread.join();
+    }
+    if (m_inotify >= 0)
+    {
+      close(m_inotify);
+    }
+    if (m_wakeup >= 0)
+    {
+      close(m_wakeup);
+    }
+  }
+
+  FileCache::Shard &FileCache::shardOf(const std::string &path)
+  {
+    return m_shards[std::hash<std::string>()(path) % kShards];
+  }
+
+  FileCache::Entry::ptr FileCache::get(const std::string &path)
+  {
+    Shard &shard = shardOf(path);
+    uint64_t gen;
+    {
+      std::lock_guard<std::mutex> lock(shard.mutex);
+      auto it = shard.entries.find(path);
+      if (it != shard.entries.end())
+      {
+        shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+        ++shard.hits;
+        return *it->second;
+      }
+      ++shard.misses;
+      gen = shard.gen;
+    }
+    // 先注册监听再打开, 避免错过打开期间的修改; 打开和fstat不持有分片锁
+    watch(dirName(path));
+    Entry::ptr entry = open(path);
+    if (!entry || m_inotify < 0)
+    {
+      // 没有inotify无法保证一致性, 不缓存
+      return entry;
+    }
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    if (shard.gen != gen)
+    {
+      // 打开期间有文件失效, 结果可能已过期, 本次直接使用但不缓存
+      return entry;
+    }
+    auto it = shard.entries.find(path);
+    if (it != shard.entries.end())
+    {
+      // 其他线程已先一步缓存
+      return *it->second;
+    }
+    shard.lru.push_front(entry);
+    shard.entries[path] = shard.lru.begin();
+    while (shard.lru.size() > m_capacity)
+    {
+      shard.entries.erase(shard.lru.back()->path);
+      shard.lru.pop_back();
+    }
+    return entry;
+  }
+
+  FileCache::Entry::ptr FileCache::open(const std::string &path)
+  {
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+      return nullptr;
+    }
+    Entry::ptr entry(new Entry);
+    entry->fd = fd;
+    entry->path = path;
+    if (fstat(fd, &entry->st) != 0 || !S_ISREG(entry->st.st_mode))
+    {
+      return nullptr;
+    }
+    char buf[96];
+    snprintf(buf, sizeof(buf), "\"%lx-%lx-%lx\"", (unsigned long)entry->st.st_ino, (unsigned long)entry->st.st_size,
+             (unsigned long)(entry->st.st_mtim.tv_sec * 1000000000ull + entry->st.st_mtim.tv_nsec));
+    entry->etag = buf;
+    entry->headers = std::string("Content-Type: ") + contentType(path) + "\r\n" + "Last-Modified: " + HttpDate(entry->st.st_mtime) + "\r\n" + "ETag: " + entry->etag + "\r\n" + "Accept-Ranges: bytes\r\n";
+    if ((uint64_t)entry->st.st_size <= kInlineSize)
+    {
+      entry->body.resize(entry->st.st_size);
+      ssize_t n = entry->st.st_size ? pread(fd, &entry->body[0], entry->body.size(), 0) : 0;
+      // 读取期间文件被截断时退回sendfile
+      entry->inlined = n == entry->st.st_size;
+      if (!entry->inlined)
+      {
+        entry->body.clear();
+      }
+    }
+    return entry;
+  }
+
+  void FileCache::invalidate(const std::string &path)
+  {
+    Shard &shard = shardOf(path);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    eraseLocked(shard, path);
+  }
+
+  size_t FileCache::size()
+  {
+    size_t n = 0;
+    for (auto &i : m_shards)
+    {
+      std::lock_guard<std::mutex> lock(i.mutex);
+      n += i.lru.size();
+    }
+    return n;
+  }
+
+  uint64_t FileCache::getHits()
+  {
+    uint64_t n = 0;
+    for (auto &i : m_shards)
+    {
+      std::lock_guard<std::mutex> lock(i.mutex);
+      n += i.hits;
+    }
+    return n;
+  }
+
+  uint64_t FileCache::getMisses()
+  {
+    uint64_t n = 0;
+    for (auto &i : m_shards)
+    {
+      std::lock_guard<std::mutex> lock(i.mutex);
+      n += i.misses;
+    }
+    return n;
+  }
+
+  void FileCache::eraseLocked(Shard &shard, const std::string &path)
+  {
+    ++shard.gen;
+    auto it = shard.entries.find(path);
+    if (it != shard.entries.end())
+    {
+      shard.lru.erase(it->second);
+      shard.entries.erase(it);
+      m_invalidations.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+
+  void FileCache::eraseDir(const std::string &dir)
+  {
+    for (auto &shard : m_shards)
+    {
+      std::lock_guard<std::mutex> lock(shard.mutex);
+      ++shard.gen;
+      for (auto e = shard.lru.begin(); e != shard.lru.end();)
+      {
+        if (dirName((*e)->path) == dir)
+        {
+          shard.entries.erase((*e)->path);
+          e = shard.lru.erase(e);
+          m_invalidations.fetch_add(1, std::memory_order_relaxed);
+        }
+        else
+        {
+          ++e;
+        }
+      }
+    }
+  }
+
+  void FileCache::clear()
+  {
+    for (auto &shard : m_shards)
+    {
+      std::lock_guard<std::mutex> lock(shard.mutex);
+      ++shard.gen;
+      m_invalidations.fetch_add(shard.lru.size(), std::memory_order_relaxed);
+      shard.lru.clear();
+      shard.entries.clear();
+    }
+  }
+
+  void FileCache::watch(const std::string &dir)
+  {
+    if (m_inotify < 0)
+    {
+      return;
+    }
+    std::lock_guard<std::mutex> lock(m_watchMutex);
+    if (m_dirWds.count(dir))
+    {
+      return;
+    }
+    int wd = inotify_add_watch(m_inotify, dir.c_str(), IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF);
+    if (wd >= 0)
+    {
+      m_wdDirs[wd] = dir;
+      m_dirWds[dir] = wd;
+    }
+  }
+
+  void FileCache::eventLoop()
+  {
+    struct pollfd pfds[2];
+    pfds[0].fd = m_inotify;
+    pfds[0].events = POLLIN;
+    pfds[1].fd = m_wakeup;
+    pfds[1].events = POLLIN;
+    while (true)
+    {
+      int rt = poll(pfds, 2, -1);
+      if (rt < 0 && errno != EINTR)
+      {
+        return;
+      }
+      if (rt > 0 && pfds[1].revents)
+      {
+        return;
+      }
+      if (rt > 0 && pfds[0].revents)
+      {
+        processEvents();
+      }
+    }
+  }
+
+  void FileCache::processEvents()
+  {
+    alignas(struct inotify_event) char buf[4096];
+    while (true)
+    {
+      ssize_t n = read(m_inotify, buf, sizeof(buf));
+      if (n <= 0)
+      {
+        return;
+      }
+      for (char *p = buf; p < buf + n;)
+      {
+        struct inotify_event *ev = (struct inotify_event *)p;
+        p += sizeof(struct inotify_event) + ev->len;
+        if (ev->mask & IN_Q_OVERFLOW)
+        {
+          // 事件丢失, 只能全部失效
+          clear();
+          continue;
+        }
+        std::string dir;
+        {
+          std::lock_guard<std::mutex> lock(m_watchMutex);
+          auto it = m_wdDirs.find(ev->wd);
+          if (it == m_wdDirs.end())
+          {
+            continue;
+          }
+          dir = it->second;
+          if (ev->mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED))
+          {
+            if (!(ev->mask & IN_IGNORED))
+            {
+              inotify_rm_watch(m_inotify, ev->wd);
+            }
+            m_dirWds.erase(dir);
+            m_wdDirs.erase(it);
+          }
+        }
+        if (ev->len)
+        {
+          std::string path = dir == "/" ? "/" + std::string(ev->name) : dir + "/" + ev->name;
+          Shard &shard = shardOf(path);
+          std::lock_guard<std::mutex> lock(shard.mutex);
+          eraseLocked(shard, path);
+        }
+        if (ev->mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED))
+        {
+          // 目录本身失效, 清掉其下的缓存
+          eraseDir(dir);
+        }
+      }
+    }
+  }
+
+  StaticFileHandler::StaticFileHandler(const std::string &root, size_t cache_capacity) : m_root(root), m_cache(cache_capacity)
+  {
+    while (m_root.size() > 1 && m_root.back() == '/')
+    {
+      m_root.pop_back();
+    }
+  }
+
+  bool StaticFileHandler::sendError(int sockfd, int status, bool keepalive)
+  {
+    std::string body = std::to_string(status) + " " + HttpStatusText(status) + "\n";
+    std::string rsp = "HTTP/1.1 " + std::to_string(status) + " " + HttpStatusText(status) + "\r\nContent-Type: text/plain\r\nContent-Length: " + std::to_string(body.size()) + "\r\nConnection: " + (keepalive ? "keep-alive" : "close") + "\r\n\r\n" + body;
+    return WriteAll(sockfd, rsp.data(), rsp.size()) && keepalive;
+  }
+
+  // 解析单段Range, 返回false表示不满足; 格式不支持时保持整个文件
+  static bool parseRange(const std::string &range, uint64_t size, uint64_t &start, uint64_t &len, bool &partial)
+  {
+    partial = false;
+    if (range.compare(0, 6, "bytes=") != 0 || range.find(',') != std::string::npos)
+    {
+      return true;
+    }
+    std::string spec = range.substr(6);
+    size_t dash = spec.find('-');
+    if (dash == std::string::npos)
+    {
+      return true;
+    }
+    std::string a = spec.substr(0, dash);
+    std::string b = spec.substr(dash + 1);
+    if (a.find_first_not_of("0123456789") != std::string::npos || b.find_first_not_of("0123456789") != std::string::npos || (a.empty() && b.empty()))
+    {
+      return true;
+    }
+    uint64_t first, last;
+    if (a.empty())
+    {
+      // 最后n个字节
+      uint64_t n = strtoull(b.c_str(), nullptr, 10);
+      if (n == 0 || size == 0)
+      {
+        return false;
+      }
+      first = n >= size ? 0 : size - n;
+      last = size - 1;
+    }
+    else
+    {
+      first = strtoull(a.c_str(), nullptr, 10);
+      last = b.empty() ? size - 1 : std::min<uint64_t>(strtoull(b.c_str(), nullptr, 10), size - 1);
+      if (first >= size || first > last)
+      {
+        return false;
+      }
+    }
+    start = first;
+    len = last - first + 1;
+    partial = true;
+    return true;
+  }
+
+  bool StaticFileHandler::handle(int sockfd, const HttpRequest &req)
+  {
+    bool keepalive = req.isKeepAlive();
+    bool head = req.getMethod() == "HEAD";
+    if (!head && req.getMethod() != "GET")
+    {
+      return sendError(sockfd, 405, keepalive);
+    }
+    std::string path = req.getPath();
+    if (path.find("/../") != std::string::npos || (path.size() >= 3 && path.compare(path.size() - 3, 3, "/..") == 0))
+    {
+      return sendError(sockfd, 403, keepalive);
+    }
+    if (path.back() == '/')
+    {
+      path += "index.html";
+    }
+    FileCache::Entry::ptr entry = m_cache.get(m_root + path);
+    if (!entry)
+    {
+      return sendError(sockfd, 404, keepalive);
+    }
+
+    uint64_t size = entry->st.st_size;
+    uint64_t start = 0;
+    uint64_t len = size;
+    int status = 200;
+    std::string inm = req.getHeader("if-none-match");
+    std::string range = req.getHeader("range");
+    std::string ifRange = req.getHeader("if-range");
+    if (!inm.empty() && inm == entry->etag)
+    {
+      status = 304;
+      len = 0;
+    }
+    else if (!range.empty() && (ifRange.empty() || ifRange == entry->etag))
+    {
+      bool partial = false;
+      if (!parseRange(range, size, start, len, partial))
+      {
+        std::string rsp = "HTTP/1.1 416 " + std::string(HttpStatusText(416)) + "\r\nContent-Range: bytes */" + std::to_string(size) + "\r\nContent-Length: 0\r\nConnection: " + (keepalive ? "keep-alive" : "close") + "\r\n\r\n";
+        return WriteAll(sockfd, rsp.data(), rsp.size()) && keepalive;
+      }
+      status = partial ? 206 : 200;
+    }
+
+    std::string rsp;
+    rsp.reserve(256 + entry->headers.size());
+    rsp.append("HTTP/1.1 ").append(std::to_string(status)).append(" ").append(HttpStatusText(status)).append("\r\n");
+    rsp.append(entry->headers);
+    if (status == 206)
+    {
+      rsp.append("Content-Range: bytes ").append(std::to_string(start)).append("-").append(std::to_string(start + len - 1)).append("/").append(std::to_string(size)).append("\r\n");
+    }
+    if (status != 304)
+    {
+      rsp.append("Content-Length: ").append(std::to_string(len)).append("\r\n");
+    }
+    rsp.append("Connection: ").append(keepalive ? "keep-alive" : "close").append("\r\n\r\n");
+    bool body = !head && len > 0;
+    if (body && entry->inlined)
+    {
+      rsp.append(entry->body, start, len);
+      return WriteAll(sockfd, rsp.data(), rsp.size()) && keepalive;
+    }
+    // 有响应体时用MSG_MORE让响应头和文件内容合并成尽量少的TCP段
+    if (!WriteAll(sockfd, rsp.data(), rsp.size(), body ? MSG_MORE : 0))
+    {
+      return false;
+    }
+    if (body && !SendFile(sockfd, entry->fd, start, len))
+    {
+      return false;
+    }
+    return keepalive;
+  }
+}
@@ -0,0 +1,270 @@
+#include "trace.h"
+#include "util.h"
+#include <unistd.h>
+#include <chrono>
+
+namespace xie
+{
+  std::atomic<bool> Tracer::s_enabled{false};
+
+  uint64_t TraceClock::nowNS()
+  {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+  }
+
+  namespace
+  {
+    struct TraceRegistry
+    {
+      std::mutex mutex;
+      std::vector<TraceRing::ptr> rings;
+      uint64_t dropped = 0; // 已清理缓冲的丢弃数
+      uint64_t baseTick = TraceClock::now();
+      uint64_t baseNS = TraceClock::nowNS();
+    };
+
+    TraceRegistry &GetRegistry()
+    {
+      static TraceRegistry *s_registry = new TraceRegistry; // 不析构, 线程退出顺序无关
+      return *s_registry;
+    }
+    // 加载时记录时钟基准
+    static TraceRegistry &s_registry_init = GetRegistry();
+
+    // 线程退出时标记缓冲, 由导出线程读空后回收
+    struct RingHolder
+    {
+      TraceRing::ptr ring;
+      ~RingHolder()
+      {
+        if (ring)
+        {
+          ring->setExited();
+        }
+      }
+    };
+  }
+
+  size_t TraceRing::drain(std::vector<TraceEvent> &out)
+  {
+    uint64_t tail = m_tail.load(std::memory_order_relaxed);
+    uint64_t head = m_head.load(std::memory_order_acquire);
+    for (uint64_t i = tail; i < head; ++i)
+    {
+      out.push_back(m_events[i & (kSize - 1)]);
+    }
+    m_tail.store(head, std::memory_order_release);
+    return head - tail;
+  }
+
+  static thread_local TraceRing *t_ring = nullptr;
+
+  // 环形缓冲是单生产者的, 不能让编译器把协程切换前算出的线程局部变量地址带到切换之后
+  __attribute__((noinline)) TraceRing *Tracer::GetRing()
+  {
+    TraceRing **ring = &t_ring;
+    asm volatile(""
+                 : "+r"(ring));
+    if (!*ring)
+    {
+      *ring = CreateRing();
+    }
+    return *ring;
+  }
+
+  TraceRing *Tracer::CreateRing()
+  {
+    static thread_local RingHolder t_holder;
+    t_holder.ring.reset(new TraceRing(getThreadID()));
+    TraceRegistry &r = GetRegistry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    r.rings.push_back(t_holder.ring);
+    return t_holder.ring.get();
+  }
+
+  void Tracer::Collect(std::vector<ThreadEvents> &out)
+  {
+    TraceRegistry &r = GetRegistry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    for (auto it = r.rings.begin(); it != r.rings.end();)
+    {
+      // 先读退出标记再读空, 保证退出前写入的事件不会漏掉
+      bool exited = (*it)->isExited();
+      ThreadEvents te;
+      te.tid = (*it)->getTid();
+      (*it)->drain(te.events);
+      if (!te.events.empty())
+      {
+        out.push_back(std::move(te));
+      }
+      if (exited)
+      {
+        r.dropped += (*it)->getDropped();
+        it = r.rings.erase(it);
+      }
+      else
+      {
+        ++it;
+      }
+    }
+  }
+
+  uint64_t Tracer::GetDropped()
+  {
+    TraceRegistry &r = GetRegistry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    uint64_t n = r.dropped;
+    for (auto &i : r.rings)
+    {
+      n += i->getDropped();
+    }
+    return n;
+  }
+
+  double Tracer::NSPerTick()
+  {
+#if defined(__x86_64__) || defined(__i386__)
+    // 用启动至今的TSC增量与单调时钟增量校准, 运行越久越准
+    TraceRegistry &r = GetRegistry();
+    uint64_t tick = TraceClock::now();
+    uint64_t ns = TraceClock::nowNS();
+    return tick > r.baseTick ? (double)(ns - r.baseNS) / (tick - r.baseTick) : 1.0;
+#else
+    return 1.0;
+#endif
+  }
+
+  double Tracer::TicksToNS(uint64_t ticks, double ns_per_tick)
+  {
+    return ((double)ticks - (double)GetRegistry().baseTick) * ns_per_tick;
+  }
+
+  TraceExporter::TraceExporter(const std::string &filename, uint32_t interval_ms) : m_filename(filename), m_interval(interval_ms)
+  {
+  }
+
+  TraceExporter::~TraceExporter()
+  {
+    stop();
+  }
+
+  bool TraceExporter::start()
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_stop)
+    {
+      return true;
+    }
+    m_ofs.open(m_filename);
+    if (!m_ofs)
+    {
+      return false;
+    }
+    m_ofs << "{\"traceEvents\":[";
+    m_first = true;
+    m_namedTids.clear();
+    m_stop = false;
+    Tracer::SetEnabled(true);
+    m_thread = std::thread(&TraceExporter::run, this);
+    return true;
+  }
+
+  void TraceExporter::stop()
+  {
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      if (m_stop)
+      {
+        return;
+      }
+      m_stop = true;
+      Tracer::SetEnabled(false);
+    }
+    m_cond.notify_one();
+    if (m_thread.joinable())
+    {
+      m_thread.join();
+    }
+    std::lock_guard<std::mutex> lock(m_mutex);
+    exportEvents();
+    m_ofs << "],\"displayTimeUnit\":\"ns\",\"otherData\":{\"dropped\":" << Tracer::GetDropped() << "}}";
+    m_ofs.close();
+  }
+
+  void TraceExporter::flush()
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_stop)
+    {
+      exportEvents();
+      m_ofs.flush();
+    }
+  }
+
+  void TraceExporter::run()
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (!m_stop)
+    {
+      m_cond.wait_for(lock, std::chrono::milliseconds(m_interval));
+      if (!m_stop)
+      {
+        exportEvents();
+      }
+    }
+  }
+
+  static void writeJsonString(std::ostream &os, const char *str)
+  {
+    os << '"';
+    for (const char *p = str; *p; ++p)
+    {
+      if (*p == '"' || *p == '\\')
+      {
+        os << '\\' << *p;
+      }
+      else if ((unsigned char)*p >= 0x20)
+      {
+        os << *p;
+      }
+    }
+    os << '"';
+  }
+
+  // 调用方需持有m_mutex
+  void TraceExporter::exportEvents()
+  {
+    m_events.clear();
+    Tracer::Collect(m_events);
+    pid_t pid = getpid();
+    double ratio = Tracer::NSPerTick();
+    char buf[64];
+    for (auto &te : m_events)
+    {
+      bool named = false;
+      for (auto &i : m_namedTids)
+      {
+        named = named || i == te.tid;
+      }
+      if (!named)
+      {
+        m_namedTids.push_back(te.tid);
+        m_ofs << (m_first ? "" : ",") << "\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" << pid << ",\"tid\":" << te.tid
+              << ",\"args\":{\"name\":\"thread-" << te.tid << "\"}}";
+        m_first = false;
+      }
+      for (auto &e : te.events)
+      {
+        double begin = Tracer::TicksToNS(e.begin, ratio) / 1000.0;
+        double dur = (e.end - e.begin) * ratio / 1000.0;
+        m_ofs << (m_first ? "" : ",") << "\n{\"name\":";
+        writeJsonString(m_ofs, e.name);
+        snprintf(buf, sizeof(buf), ",\"ts\":%.3f,\"dur\":%.3f", begin, dur);
+        m_ofs << ",\"ph\":\"X\",\"pid\":" << pid << ",\"tid\":" << te.tid << buf << "}";
+        m_first = false;
+      }
+    }
+  }
+}
@@ -1,14 +1,38 @@
 #include "util.h"
+#include "fiber.h"
+#include <sys/syscall.h>
+#include <time.h>
 
 namespace xie
 {
+  static uint64_t monotonicMS()
+  {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000ull + ts.tv_nsec / 1000000;
+  }
+
+  static uint64_t startMS()
+  {
+    static uint64_t s_start = monotonicMS();
+    return s_start;
+  }
+  // 加载时即记录启动时间, 避免第一次打日志才开始计时
+  static uint64_t s_start_init = startMS();
+
   uint32_t getThreadID()
   {
-    return getpid();
+    static thread_local uint32_t t_tid = syscall(SYS_gettid);
+    return t_tid;
   }
 
   uint32_t getFiberID()
   {
-    return 0;
+    return Fiber::GetFiberId();
+  }
+
+  uint32_t getElapseMS()
+  {
+    return monotonicMS() - startMS();
   }
 }
\ No newline at end of file
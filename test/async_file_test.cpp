@@ -0,0 +1,100 @@
+#include "log.h"
+#include "async_file.h"
+#include <iostream>
+#include <fstream>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+static const int kThreads = 4;
+static const int kLines = 50000;
+
+// 多线程写日志, 返回耗时(ms)
+static int64_t writeLogs(xie::Logger::ptr logger)
+{
+  auto begin = std::chrono::steady_clock::now();
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kThreads; ++t)
+  {
+    threads.push_back(std::thread([logger, t]()
+                                  {
+                                    for (int i = 0; i < kLines; ++i)
+                                    {
+                                      XIE_LOG_INFO(logger) << "thread " << t << " line " << i;
+                                    } }));
+  }
+  for (auto &i : threads)
+  {
+    i.join();
+  }
+  return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - begin).count();
+}
+
+static int64_t countLines(const std::string &filename)
+{
+  std::ifstream ifs(filename);
+  std::string line;
+  int64_t n = 0;
+  while (std::getline(ifs, line))
+  {
+    if (line.find(" line ") == std::string::npos)
+    {
+      std::cout << "bad line: " << line << std::endl;
+      return -1;
+    }
+    ++n;
+  }
+  return n;
+}
+
+static bool runCase(const std::string &name, const xie::AsyncFileWriter::Options &opt)
+{
+  std::string filename = "./async_" + name + ".log";
+  unlink(filename.c_str());
+  xie::Logger::ptr logger(new xie::Logger(name));
+  xie::AsyncFileLogAppender::ptr appender(new xie::AsyncFileLogAppender(filename, opt));
+  appender->setFormat(xie::logFormatter::ptr(new xie::logFormatter("%d%T%t%T[%p]%T%m%n")));
+  logger->addAppender(appender);
+
+  int64_t cost = writeLogs(logger);
+  appender->flush();
+  auto m = appender->getMetrics();
+  int64_t lines = countLines(filename);
+  std::cout << name << (appender->getWriter()->usingUring() ? "(io_uring)" : "(pwritev)") << ": " << cost << "ms lines=" << lines << " bytes=" << m.bytes_written
+            << " writes=" << m.writes << " syscalls=" << m.syscalls << " errors=" << m.errors
+            << " avg_latency=" << m.avg_latency_us << "us max_latency=" << m.max_latency_us << "us" << std::endl;
+
+  // 追加写: 重新打开后数据接在文件末尾
+  logger->delAppender(appender);
+  appender.reset(new xie::AsyncFileLogAppender(filename, opt));
+  appender->setFormat(xie::logFormatter::ptr(new xie::logFormatter("%m%n")));
+  logger->addAppender(appender);
+  XIE_LOG_INFO(logger) << "reopen line 0";
+  appender->flush();
+  int64_t total = countLines(filename);
+  unlink(filename.c_str());
+  return lines == kThreads * kLines && total == lines + 1 && m.errors == 0;
+}
+
+int main()
+{
+  std::string filename = "./sync_file.log";
+  xie::Logger::ptr logger(new xie::Logger("sync"));
+  xie::FileLogAppender::ptr appender(new xie::FileLogAppender(filename));
+  appender->setFormat(xie::logFormatter::ptr(new xie::logFormatter("%d%T%t%T[%p]%T%m%n")));
+  logger->addAppender(appender);
+  std::cout << "FileLogAppender: " << writeLogs(logger) << "ms" << std::endl;
+  unlink(filename.c_str());
+
+  bool ok = true;
+  xie::AsyncFileWriter::Options opt;
+  ok = runCase("uring", opt) && ok;
+  opt.use_uring = false;
+  ok = runCase("pwritev", opt) && ok;
+  opt.use_uring = true;
+  opt.direct = true;
+  opt.block_size = 64 * 1024;
+  ok = runCase("direct", opt) && ok;
+  std::cout << (ok ? "PASS" : "FAIL") << std::endl;
+  return ok ? 0 : 1;
+}
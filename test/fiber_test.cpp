@@ -0,0 +1,285 @@
+#include "fiber_sync.h"
+#include "util.h"
+#include <iostream>
+#include <chrono>
+#include <thread>
+#include <condition_variable>
+#include <signal.h>
+#include <sys/wait.h>
+
+// 对照组: std::mutex + std::condition_variable实现的有界阻塞队列
+template <class T>
+class BlockingQueue
+{
+public:
+  BlockingQueue(size_t capacity) : m_capacity(capacity) {}
+  void push(T v)
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_notFull.wait(lock, [this]()
+                   { return m_queue.size() < m_capacity; });
+    m_queue.push_back(std::move(v));
+    m_notEmpty.notify_one();
+  }
+  T pop()
+  {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_notEmpty.wait(lock, [this]()
+                    { return !m_queue.empty(); });
+    T v = std::move(m_queue.front());
+    m_queue.pop_front();
+    m_notFull.notify_one();
+    return v;
+  }
+
+private:
+  size_t m_capacity;
+  std::mutex m_mutex;
+  std::condition_variable m_notEmpty;
+  std::condition_variable m_notFull;
+  std::deque<T> m_queue;
+};
+
+static double elapsed(std::chrono::steady_clock::time_point begin)
+{
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+}
+
+static void report(const char *name, const char *impl, int ops, double sec)
+{
+  std::cout << name << " " << impl << ": " << (int)(ops / sec) << " ops/s " << (int)(sec * 1e9 / ops) << " ns/op" << std::endl;
+}
+
+static void pingPong(int rounds)
+{
+  {
+    xie::Scheduler sched(1);
+    xie::Channel<int> ping, pong;
+    auto begin = std::chrono::steady_clock::now();
+    sched.schedule([&]()
+                   {
+                     int v;
+                     for (int i = 0; i < rounds; ++i)
+                     {
+                       ping.send(i);
+                       pong.recv(v);
+                     } });
+    sched.schedule([&]()
+                   {
+                     int v;
+                     for (int i = 0; i < rounds; ++i)
+                     {
+                       ping.recv(v);
+                       pong.send(v);
+                     } });
+    sched.start();
+    sched.stop();
+    report("ping-pong", "fiber channel", rounds, elapsed(begin));
+  }
+  {
+    BlockingQueue<int> ping(1), pong(1);
+    auto begin = std::chrono::steady_clock::now();
+    std::thread a([&]()
+                  {
+                    for (int i = 0; i < rounds; ++i)
+                    {
+                      ping.push(i);
+                      pong.pop();
+                    } });
+    std::thread b([&]()
+                  {
+                    for (int i = 0; i < rounds; ++i)
+                    {
+                      pong.push(ping.pop());
+                    } });
+    a.join();
+    b.join();
+    report("ping-pong", "std::mutex+cv", rounds, elapsed(begin));
+  }
+}
+
+static void fanIn(int producers, int per_producer)
+{
+  int total = producers * per_producer;
+  {
+    xie::Scheduler sched(1);
+    xie::Channel<int> ch(64);
+    long long sum = 0;
+    auto begin = std::chrono::steady_clock::now();
+    for (int p = 0; p < producers; ++p)
+    {
+      sched.schedule([&]()
+                     {
+                       for (int i = 0; i < per_producer; ++i)
+                       {
+                         ch.send(i);
+                       } });
+    }
+    sched.schedule([&]()
+                   {
+                     int v;
+                     for (int i = 0; i < total; ++i)
+                     {
+                       ch.recv(v);
+                       sum += v;
+                     } });
+    sched.start();
+    sched.stop();
+    report("fan-in", "fiber channel", total, elapsed(begin));
+  }
+  {
+    BlockingQueue<int> q(64);
+    long long sum = 0;
+    auto begin = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (int p = 0; p < producers; ++p)
+    {
+      threads.push_back(std::thread([&]()
+                                    {
+                                      for (int i = 0; i < per_producer; ++i)
+                                      {
+                                        q.push(i);
+                                      } }));
+    }
+    for (int i = 0; i < total; ++i)
+    {
+      sum += q.pop();
+    }
+    for (auto &i : threads)
+    {
+      i.join();
+    }
+    report("fan-in", "std::mutex+cv", total, elapsed(begin));
+  }
+}
+
+static int recurse(int depth)
+{
+  // 16KB的栈远在到达上限前就会撞上保护页, 上限只是让递归有出口
+  if (depth > (1 << 20))
+  {
+    return 0;
+  }
+  volatile char buf[1024];
+  buf[0] = (char)depth;
+  return recurse(depth + 1) + buf[0];
+}
+
+// 子进程中让协程栈溢出, 应当撞上保护页而死于SIGSEGV
+static bool stackGuard()
+{
+  pid_t pid = fork();
+  if (pid == 0)
+  {
+    xie::Scheduler sched(1);
+    sched.schedule(xie::Fiber::ptr(new xie::Fiber([]()
+                                                  { recurse(0); },
+                                                  16 * 1024)));
+    sched.start();
+    sched.stop();
+    _exit(0);
+  }
+  int status = 0;
+  waitpid(pid, &status, 0);
+  return WIFSIGNALED(status) && WTERMSIG(status) == SIGSEGV;
+}
+
+int main()
+{
+  bool ok = true;
+  ok = ok && xie::getFiberID() == 0;
+  bool guard = stackGuard();
+  std::cout << "stack guard: " << (guard ? "ok" : "failed") << std::endl;
+  ok = ok && guard;
+
+  // 两个线程的调度器上验证互斥锁、条件变量、信号量和通道
+  xie::Scheduler sched(2);
+  xie::FiberMutex mutex;
+  xie::FiberCondVar cond;
+  xie::FiberSemaphore sem(2);
+  std::atomic<int> inside{0};
+  std::atomic<int> maxInside{0};
+  std::atomic<bool> idOk{true};
+  int counter = 0;
+  int ready = 0;
+  int woken = 0;
+  xie::Channel<int> unbounded(xie::Channel<int>::kUnbounded);
+  xie::Channel<std::string> closing(1);
+  int received = 0;
+  bool sendAfterClose = true;
+
+  for (int i = 0; i < 16; ++i)
+  {
+    sched.schedule([&]()
+                   {
+                     if (xie::getFiberID() != xie::Fiber::GetThis()->getId() || xie::getFiberID() == 0)
+                     {
+                       idOk = false;
+                     }
+                     for (int j = 0; j < 1000; ++j)
+                     {
+                       std::lock_guard<xie::FiberMutex> lock(mutex);
+                       ++counter;
+                       if (j % 100 == 0)
+                       {
+                         xie::Fiber::Yield(); // 持锁让出, 迫使其他协程进入等待队列
+                       }
+                     }
+                     sem.wait();
+                     int n = ++inside;
+                     int m = maxInside;
+                     while (n > m && !maxInside.compare_exchange_weak(m, n))
+                     {
+                     }
+                     xie::Fiber::Yield();
+                     --inside;
+                     sem.post();
+                     std::lock_guard<xie::FiberMutex> lock(mutex);
+                     cond.wait(mutex, [&]()
+                               { return ready > 0; });
+                     ++woken; });
+  }
+  sched.schedule([&]()
+                 {
+                   for (int i = 0; i < 20; ++i)
+                   {
+                     xie::Fiber::Yield();
+                   }
+                   std::lock_guard<xie::FiberMutex> lock(mutex);
+                   ready = 1;
+                   cond.notify_all(); });
+  sched.schedule([&]()
+                 {
+                   for (int i = 0; i < 10000; ++i)
+                   {
+                     unbounded.send(i);
+                   }
+                   unbounded.close();
+                   closing.send("a");
+                   closing.send("b"); // 容量为1, 在此阻塞直到接收方取走"a"
+                   closing.close();
+                   sendAfterClose = closing.send("c"); });
+  sched.schedule([&]()
+                 {
+                   int v;
+                   while (unbounded.recv(v))
+                   {
+                     received += v == received;
+                   }
+                   std::string s;
+                   while (closing.recv(s))
+                   {
+                     received += s.size();
+                   } });
+  sched.start();
+  sched.stop();
+  ok = ok && idOk && counter == 16000 && maxInside <= 2 && woken == 16;
+  ok = ok && received == 10002 && !sendAfterClose;
+  std::cout << "correctness: " << (ok ? "ok" : "failed") << " counter=" << counter << " max_inside=" << maxInside
+            << " woken=" << woken << " received=" << received << " switches=" << sched.getSwitches() << std::endl;
+
+  pingPong(200000);
+  fanIn(8, 50000);
+  std::cout << (ok ? "PASS" : "FAIL") << std::endl;
+  return ok ? 0 : 1;
+}
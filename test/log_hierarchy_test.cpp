@@ -0,0 +1,95 @@
+#include "log.h"
+#include <iostream>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+// 只统计输出次数的appender
+class CountAppender : public xie::logAppender
+{
+public:
+  typedef std::shared_ptr<CountAppender> ptr;
+  void log(std::shared_ptr<xie::Logger> logger, xie::LogLevel::Level level, xie::logEvent::ptr event) override
+  {
+    if (level >= m_level)
+    {
+      ++m_count;
+    }
+  }
+  int m_count = 0;
+};
+
+int main()
+{
+  bool ok = true;
+  auto mgr = xie::LogMgr::GetInstance();
+  xie::Logger::ptr root = XIE_LOG_ROOT();
+
+  xie::Logger::ptr abc = XIE_LOG_NAME("system.net.tcp");
+  xie::Logger::ptr ab = XIE_LOG_NAME("system.net");
+  xie::Logger::ptr a = XIE_LOG_NAME("system");
+  ok = ok && abc->getParent() == ab && ab->getParent() == a && a->getParent() == root;
+  ok = ok && mgr->getLogger("system.net.tcp") == abc && mgr->getLogger("") == root && mgr->getLogger("root") == root;
+
+  // 级别继承与传递
+  root->setLevel(xie::LogLevel::WARN);
+  ok = ok && abc->getLevel() == xie::LogLevel::WARN && !abc->hasLevel();
+  a->setLevel(xie::LogLevel::DEBUG);
+  ok = ok && abc->getLevel() == xie::LogLevel::DEBUG && root->getLevel() == xie::LogLevel::WARN;
+  ab->setLevel(xie::LogLevel::ERROR);
+  a->setLevel(xie::LogLevel::INFO);
+  ok = ok && abc->getLevel() == xie::LogLevel::ERROR && ab->getLevel() == xie::LogLevel::ERROR;
+  ab->resetLevel();
+  ok = ok && abc->getLevel() == xie::LogLevel::INFO;
+
+  // appender沿层级向上传递
+  CountAppender::ptr rootCount(new CountAppender);
+  CountAppender::ptr netCount(new CountAppender);
+  root->addAppender(rootCount);
+  ab->addAppender(netCount);
+  XIE_LOG_INFO(abc) << "tcp info";
+  XIE_LOG_DEBUG(abc) << "tcp debug, filtered";
+  ok = ok && netCount->m_count == 1 && rootCount->m_count == 1;
+  ab->setAdditive(false);
+  XIE_LOG_WARN(abc) << "tcp warn";
+  ok = ok && netCount->m_count == 2 && rootCount->m_count == 1;
+  ab->setAdditive(true);
+  root->delAppender(rootCount);
+  ab->delAppender(netCount);
+  root->setLevel(xie::LogLevel::DEBUG);
+
+  // 并发创建同名logger得到同一个对象
+  std::vector<std::thread> threads;
+  std::vector<xie::Logger::ptr> got(8);
+  for (size_t t = 0; t < got.size(); ++t)
+  {
+    threads.push_back(std::thread([&got, t]()
+                                  {
+                                    for (int i = 0; i < 1000; ++i)
+                                    {
+                                      XIE_LOG_NAME("concurrent.m" + std::to_string(i));
+                                    }
+                                    got[t] = XIE_LOG_NAME("concurrent.m999"); }));
+  }
+  for (auto &i : threads)
+  {
+    i.join();
+  }
+  for (auto &i : got)
+  {
+    ok = ok && i == got[0] && i->getParent() == mgr->getLogger("concurrent");
+  }
+
+  std::string name = "system.net.tcp";
+  auto begin = std::chrono::steady_clock::now();
+  for (int i = 0; i < 1000000; ++i)
+  {
+    mgr->getLogger(name);
+  }
+  double cost = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - begin).count() / 1000000;
+  std::cout << "getLogger: " << cost << "ns" << std::endl;
+
+  XIE_LOG_INFO(XIE_LOG_NAME("system.net.tcp")) << "inherits root stdout appender";
+  std::cout << (ok ? "PASS" : "FAIL") << std::endl;
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,133 @@
+#include "log.h"
+#include "log_reader.h"
+#include <iostream>
+#include <chrono>
+#include <vector>
+#include <stdio.h>
+#include <string.h>
+
+static const int64_t kSeconds = 86400;
+static const int kPerSecond = 4;
+
+static size_t countLines(const std::vector<xie::LogReader::Record> &records)
+{
+  size_t n = 0;
+  for (auto &r : records)
+  {
+    for (size_t i = 0; i < r.size; ++i)
+    {
+      n += r.data[i] == '\n';
+    }
+  }
+  return n;
+}
+
+static std::string join(const std::vector<xie::LogReader::Record> &records)
+{
+  std::string rt;
+  for (auto &r : records)
+  {
+    rt.append(r.data, r.size);
+  }
+  return rt;
+}
+
+template <typename F>
+static double costMS(F f)
+{
+  auto begin = std::chrono::steady_clock::now();
+  f();
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+}
+
+int main()
+{
+  std::string filename = "./index_test.log";
+  struct tm tm;
+  memset(&tm, 0, sizeof(tm));
+  strptime("2026-01-01 00:00:00", "%Y-%m-%d %H:%M:%S", &tm);
+  tm.tm_isdst = -1;
+  int64_t t0 = mktime(&tm);
+  int64_t qbegin = t0 + 10 * 3600;
+  int64_t qend = t0 + 11 * 3600 - 1;
+
+  // 生成一天的日志, 同时统计预期的查询结果
+  std::vector<xie::Logger::ptr> loggers = {xie::Logger::ptr(new xie::Logger("app.db")), xie::Logger::ptr(new xie::Logger("app.net")),
+                                           xie::Logger::ptr(new xie::Logger("app.net.tcp")), xie::Logger::ptr(new xie::Logger("other"))};
+  size_t expectFiltered = 0;
+  size_t expectLines = 0;
+  {
+    xie::FileLogAppender::ptr appender(new xie::FileLogAppender(filename, true));
+    for (auto &l : loggers)
+    {
+      l->addAppender(appender);
+    }
+    uint64_t seq = 0;
+    for (int64_t t = t0; t < t0 + kSeconds; ++t)
+    {
+      for (int i = 0; i < kPerSecond; ++i, ++seq)
+      {
+        xie::Logger::ptr logger = loggers[seq % loggers.size()];
+        xie::LogLevel::Level level = seq % 97 == 0 ? xie::LogLevel::ERROR : (seq % 3 ? xie::LogLevel::INFO : xie::LogLevel::DEBUG);
+        xie::logEvent::ptr event(new xie::logEvent(level, logger, __FILE__, __LINE__, 1, 0, 0, t));
+        event->getss() << "request " << seq << " done";
+        bool multiline = seq % 1000 == 0;
+        if (multiline)
+        {
+          event->getss() << "\n  continuation of " << seq;
+        }
+        logger->log(level, event);
+        if (t >= qbegin && t <= qend)
+        {
+          expectLines += multiline ? 2 : 1;
+          if (level == xie::LogLevel::ERROR && logger->getName().compare(0, 7, "app.net") == 0)
+          {
+            expectFiltered += multiline ? 2 : 1;
+          }
+        }
+      }
+    }
+    for (auto &l : loggers)
+    {
+      l->delAppender(appender);
+    }
+  }
+
+  bool ok = true;
+  xie::LogReader::Query window;
+  window.begin = qbegin;
+  window.end = qend;
+  xie::LogReader::Query filtered = window;
+  filtered.level_mask = 1u << xie::LogLevel::ERROR;
+  filtered.logger = "app.net";
+
+  xie::LogReader reader(filename);
+  ok = ok && reader.open() && reader.hasIndex();
+  std::vector<xie::LogReader::Record> r1, r2;
+  xie::LogReader::Stats s1, s2;
+  double c1 = costMS([&]()
+                     { r1 = reader.query(window, &s1); });
+  double c2 = costMS([&]()
+                     { r2 = reader.query(filtered, &s2); });
+  std::cout << "indexed window: " << c1 << "ms lines=" << countLines(r1) << "/" << expectLines << " blocks=" << s1.blocks
+            << " scanned=" << s1.blocks_scanned << " copied=" << s1.blocks_copied << std::endl;
+  std::cout << "indexed filtered: " << c2 << "ms lines=" << countLines(r2) << "/" << expectFiltered << " scanned=" << s2.blocks_scanned << std::endl;
+  ok = ok && countLines(r1) == expectLines && countLines(r2) == expectFiltered && s2.records * 2 > countLines(r2);
+
+  // 没有索引时全文件逐行扫描, 结果应完全一致
+  rename(xie::LogIndex::IndexFile(filename).c_str(), (filename + ".bak").c_str());
+  xie::LogReader plain(filename);
+  ok = ok && plain.open() && !plain.hasIndex();
+  std::vector<xie::LogReader::Record> r3, r4;
+  double c3 = costMS([&]()
+                     { r3 = plain.query(window); });
+  double c4 = costMS([&]()
+                     { r4 = plain.query(filtered); });
+  std::cout << "full scan window: " << c3 << "ms filtered: " << c4 << "ms" << std::endl;
+  ok = ok && join(r1) == join(r3) && join(r2) == join(r4);
+
+  unlink(filename.c_str());
+  unlink((filename + ".bak").c_str());
+  std::cout << (ok ? "PASS" : "FAIL") << std::endl;
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,100 @@
+#include "metrics.h"
+#include <iostream>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+static const int kThreads = 4;
+static const int kOps = 1000000;
+
+xie::Counter::ptr g_requests = xie::Metrics::Lookup<xie::Counter>("test.requests", "request count");
+xie::Gauge::ptr g_connections = xie::Metrics::Lookup<xie::Gauge>("test.connections", "open connections");
+xie::Histogram::ptr g_latency = xie::Metrics::Lookup<xie::Histogram>("test.latency_us", "request latency in us");
+
+template <typename F>
+static double runThreads(F f)
+{
+  auto begin = std::chrono::steady_clock::now();
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kThreads; ++t)
+  {
+    threads.push_back(std::thread(f));
+  }
+  for (auto &i : threads)
+  {
+    i.join();
+  }
+  return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - begin).count() / ((double)kThreads * kOps);
+}
+
+int main()
+{
+  bool ok = true;
+
+  // 分片计数器与单个原子变量的对比
+  std::atomic<uint64_t> single{0};
+  double sharded = runThreads([]()
+                              {
+                                for (int i = 0; i < kOps; ++i)
+                                {
+                                  g_requests->inc();
+                                } });
+  double shared = runThreads([&single]()
+                             {
+                               for (int i = 0; i < kOps; ++i)
+                               {
+                                 single.fetch_add(1, std::memory_order_relaxed);
+                               } });
+  std::cout << "counter inc: sharded=" << sharded << "ns single atomic=" << shared << "ns" << std::endl;
+  ok = ok && g_requests->GetValue() == (uint64_t)kThreads * kOps;
+
+  double observe = runThreads([]()
+                              {
+                                for (int i = 0; i < kOps; ++i)
+                                {
+                                  g_latency->observe(i % 1000 + 1);
+                                } });
+  std::cout << "histogram observe: " << observe << "ns" << std::endl;
+  auto s = g_latency->GetSnapshot();
+  uint64_t p50 = s.percentile(50);
+  uint64_t p99 = s.percentile(99);
+  std::cout << "count=" << s.count << " p50=" << p50 << " p99=" << p99 << " max=" << s.max() << " mean=" << s.mean() << std::endl;
+  ok = ok && s.count == (uint64_t)kThreads * kOps;
+  ok = ok && p50 >= 500 && p50 <= 500 * 17 / 16 && p99 >= 990 && p99 <= 990 * 17 / 16;
+
+  for (uint64_t v : {0ull, 1ull, 31ull, 32ull, 33ull, 1000ull, 123456789ull, ~0ull})
+  {
+    size_t idx = xie::Histogram::BucketIndex(v);
+    ok = ok && v <= xie::Histogram::BucketUpper(idx) && (idx == 0 || v > xie::Histogram::BucketUpper(idx - 1));
+  }
+
+  g_connections->set(10);
+  g_connections->add(-3);
+  ok = ok && g_connections->GetValue() == 7;
+
+  // 与Config::Lookup一致: 同名返回同一对象, 非法名字抛出异常
+  ok = ok && xie::Metrics::Lookup<xie::Counter>("test.requests", "") == g_requests;
+  ok = ok && !xie::Metrics::Lookup<xie::Gauge>("test.requests");
+  try
+  {
+    xie::Metrics::Lookup<xie::Counter>("test-invalid", "");
+    ok = false;
+  }
+  catch (std::invalid_argument &e)
+  {
+  }
+
+  xie::Logger::ptr logger(new xie::Logger("metrics"));
+  logger->addAppender(xie::logAppender::ptr(new xie::StdoutLogAppender));
+  xie::MetricsDumper::ptr dumper(new xie::MetricsDumper(logger, 50));
+  std::string text;
+  dumper->setHook([&text](const std::string &t)
+                  { text = t; });
+  dumper->start();
+  std::this_thread::sleep_for(std::chrono::milliseconds(120));
+  dumper->stop();
+  ok = ok && text.find("test_requests 4000000") != std::string::npos && text.find("test_latency_us_count 4000000") != std::string::npos;
+
+  std::cout << (ok ? "PASS" : "FAIL") << std::endl;
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,144 @@
+#include "rpc.h"
+#include "metrics.h"
+#include <iostream>
+#include <chrono>
+#include <thread>
+
+// 闭环压测: 始终保持concurrency个请求在途, 一个完成后立刻发出下一个
+class Bench
+{
+public:
+  Bench(xie::RpcClient &client, int concurrency, int total)
+      : m_client(client), m_concurrency(concurrency), m_total(total), m_latency("rpc.latency_us") {}
+
+  void run()
+  {
+    uint64_t frames = m_client.getFrames();
+    uint64_t writes = m_client.getWrites();
+    auto begin = std::chrono::steady_clock::now();
+    {
+      xie::RpcClient::Batch batch(m_client);
+      for (int i = 0; i < m_concurrency; ++i)
+      {
+        issue();
+      }
+    }
+    std::future<void> done = m_done.get_future();
+    done.wait();
+    double sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+    xie::Histogram::Snapshot s = m_latency.GetSnapshot();
+    std::cout << "concurrency=" << m_concurrency
+              << " calls/s=" << (int)(m_total / sec)
+              << " p50=" << s.percentile(50) << "us"
+              << " p99=" << s.percentile(99) << "us"
+              << " frames/write=" << (double)(m_client.getFrames() - frames) / (m_client.getWrites() - writes)
+              << std::endl;
+  }
+
+private:
+  void issue()
+  {
+    if (m_issued.fetch_add(1) >= m_total)
+    {
+      return;
+    }
+    auto begin = std::chrono::steady_clock::now();
+    m_client.call("echo", m_payload, [this, begin](xie::RpcClient::Result &&)
+                  {
+                    m_latency.observe(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - begin).count());
+                    if (m_completed.fetch_add(1) + 1 == m_total)
+                    {
+                      m_done.set_value();
+                    }
+                    else
+                    {
+                      issue();
+                    } });
+  }
+
+private:
+  xie::RpcClient &m_client;
+  int m_concurrency;
+  int m_total;
+  std::string m_payload = std::string(64, 'p');
+  xie::Histogram m_latency;
+  std::atomic<int> m_issued{0};
+  std::atomic<int> m_completed{0};
+  std::promise<void> m_done;
+};
+
+int main()
+{
+  xie::RpcServer server(4);
+  server.registerHandler("echo", [](const std::string &req, std::string &rsp)
+                         { rsp = req; return true; });
+  server.registerHandler("fail", [](const std::string &, std::string &)
+                         { return false; });
+  server.registerHandler("sleep", [](const std::string &, std::string &rsp)
+                         {
+                           std::this_thread::sleep_for(std::chrono::milliseconds(50));
+                           rsp = "late";
+                           return true; });
+  if (!server.bind("127.0.0.1", 0))
+  {
+    std::cout << "bind failed" << std::endl;
+    return 1;
+  }
+  server.start();
+
+  bool ok = true;
+  xie::RpcClient client;
+  ok = ok && client.connect("127.0.0.1", server.getPort());
+
+  // 帧编解码
+  xie::RpcFrame frame, decoded;
+  frame.id = 0x0102030405060708ull;
+  frame.timeout_ms = 300;
+  frame.method = "echo";
+  frame.payload = std::string("a\0b", 3);
+  std::string bytes;
+  frame.encode(bytes);
+  ok = ok && xie::RpcFrame::Decode(bytes.data(), bytes.size() - 1, decoded) == 0;
+  ok = ok && xie::RpcFrame::Decode(bytes.data(), bytes.size(), decoded) == (int64_t)bytes.size();
+  ok = ok && decoded.id == frame.id && decoded.timeout_ms == 300 && decoded.method == "echo" && decoded.payload == frame.payload;
+
+  // 同一连接上的流水线请求, 慢请求不阻塞后面的快请求
+  std::future<xie::RpcClient::Result> slow = client.call("sleep", "", 1000);
+  std::vector<std::future<xie::RpcClient::Result>> futures;
+  for (int i = 0; i < 100; ++i)
+  {
+    futures.push_back(client.call("echo", std::to_string(i)));
+  }
+  for (int i = 0; i < 100; ++i)
+  {
+    xie::RpcClient::Result r = futures[i].get();
+    ok = ok && r.status == xie::RpcStatus::OK && r.data == std::to_string(i);
+  }
+  ok = ok && slow.wait_for(std::chrono::seconds(0)) == std::future_status::timeout;
+  xie::RpcClient::Result r = slow.get();
+  ok = ok && r.status == xie::RpcStatus::OK && r.data == "late";
+
+  r = client.call("missing", "").get();
+  ok = ok && r.status == xie::RpcStatus::NOT_FOUND;
+  r = client.call("fail", "").get();
+  ok = ok && r.status == xie::RpcStatus::ERROR;
+  auto begin = std::chrono::steady_clock::now();
+  r = client.call("sleep", "", 10).get();
+  auto waited = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - begin).count();
+  ok = ok && r.status == xie::RpcStatus::TIMEOUT && waited < 45;
+  std::cout << "deadline: " << xie::RpcStatus::toString(r.status) << " after " << waited << "ms" << std::endl;
+  std::cout << "correctness: " << (ok ? "ok" : "failed") << std::endl;
+
+  int levels[] = {1, 8, 64, 256};
+  for (int c : levels)
+  {
+    Bench(client, c, 50000).run();
+  }
+
+  client.close();
+  r = client.call("echo", "").get();
+  ok = ok && r.status == xie::RpcStatus::CLOSED;
+  server.stop();
+  std::cout << (ok ? "PASS" : "FAIL") << std::endl;
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,261 @@
+#include "static_file.h"
+#include <iostream>
+#include <fstream>
+#include <functional>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+typedef std::function<bool(int, const xie::HttpRequest &)> Handler;
+
+// 每个连接一个线程的回环测试服务器
+class TestServer
+{
+public:
+  TestServer(Handler handler) : m_handler(handler)
+  {
+    m_listen = socket(AF_INET, SOCK_STREAM, 0);
+    int on = 1;
+    setsockopt(m_listen, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    bind(m_listen, (struct sockaddr *)&addr, sizeof(addr));
+    socklen_t len = sizeof(addr);
+    getsockname(m_listen, (struct sockaddr *)&addr, &len);
+    m_port = ntohs(addr.sin_port);
+    listen(m_listen, 128);
+    m_thread = std::thread([this]()
+                           {
+                             while (true)
+                             {
+                               int fd = accept(m_listen, nullptr, nullptr);
+                               if (fd < 0)
+                               {
+                                 break;
+                               }
+                               m_conns.push_back(std::thread([this, fd]()
+                                                             {
+                                                               std::string buf;
+                                                               xie::HttpRequest req;
+                                                               while (xie::HttpRequest::Read(fd, buf, req) && m_handler(fd, req))
+                                                               {
+                                                               }
+                                                               close(fd); }));
+                             } });
+  }
+  ~TestServer()
+  {
+    shutdown(m_listen, SHUT_RDWR);
+    close(m_listen);
+    m_thread.join();
+    for (auto &i : m_conns)
+    {
+      i.join();
+    }
+  }
+  int getPort() const { return m_port; }
+
+private:
+  Handler m_handler;
+  int m_listen;
+  int m_port;
+  std::thread m_thread;
+  std::vector<std::thread> m_conns;
+};
+
+static int connectTo(int port)
+{
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  connect(fd, (struct sockaddr *)&addr, sizeof(addr));
+  int on = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+  return fd;
+}
+
+struct Response
+{
+  int status = 0;
+  std::string headers;
+  std::string body;
+  uint64_t length = 0;
+};
+
+// 发送请求并读完响应; keep_body为false时只计数不保存响应体
+static bool fetch(int fd, const std::string &request, Response &rsp, std::string &buf, bool keep_body = true, bool head = false)
+{
+  if (!xie::WriteAll(fd, request.data(), request.size()))
+  {
+    return false;
+  }
+  char tmp[256 * 1024];
+  size_t end;
+  while ((end = buf.find("\r\n\r\n")) == std::string::npos)
+  {
+    ssize_t n = read(fd, tmp, sizeof(tmp));
+    if (n <= 0)
+    {
+      return false;
+    }
+    buf.append(tmp, n);
+  }
+  rsp.headers = buf.substr(0, end + 4);
+  rsp.status = atoi(buf.c_str() + 9);
+  buf.erase(0, end + 4);
+  size_t pos = rsp.headers.find("Content-Length: ");
+  rsp.length = pos == std::string::npos ? 0 : strtoull(rsp.headers.c_str() + pos + 16, nullptr, 10);
+  rsp.body.clear();
+  uint64_t left = head ? 0 : rsp.length;
+  size_t n = std::min<uint64_t>(left, buf.size());
+  if (keep_body)
+  {
+    rsp.body.append(buf, 0, n);
+  }
+  buf.erase(0, n);
+  left -= n;
+  while (left > 0)
+  {
+    ssize_t rt = read(fd, tmp, std::min<uint64_t>(left, sizeof(tmp)));
+    if (rt <= 0)
+    {
+      return false;
+    }
+    if (keep_body)
+    {
+      rsp.body.append(tmp, rt);
+    }
+    left -= rt;
+  }
+  return true;
+}
+
+// 对照组: 同样使用缓存的fd, 但通过pread()+write()经用户态缓冲发送
+static bool copyHandler(xie::FileCache &cache, const std::string &root, int fd, const xie::HttpRequest &req)
+{
+  xie::FileCache::Entry::ptr entry = cache.get(root + req.getPath());
+  if (!entry)
+  {
+    return false;
+  }
+  std::string rsp = "HTTP/1.1 200 OK\r\n" + entry->headers + "Content-Length: " + std::to_string(entry->st.st_size) + "\r\n\r\n";
+  if (!xie::WriteAll(fd, rsp.data(), rsp.size(), MSG_MORE))
+  {
+    return false;
+  }
+  static thread_local std::vector<char> buf(256 * 1024);
+  for (uint64_t off = 0; off < (uint64_t)entry->st.st_size;)
+  {
+    ssize_t n = pread(entry->fd, buf.data(), buf.size(), off);
+    if (n <= 0 || !xie::WriteAll(fd, buf.data(), n))
+    {
+      return false;
+    }
+    off += n;
+  }
+  return true;
+}
+
+static void bench(const char *name, int port, const std::string &path, int count, uint64_t size)
+{
+  int fd = connectTo(port);
+  std::string buf;
+  Response rsp;
+  std::string req = "GET " + path + " HTTP/1.1\r\nHost: localhost\r\n\r\n";
+  auto begin = std::chrono::steady_clock::now();
+  for (int i = 0; i < count; ++i)
+  {
+    fetch(fd, req, rsp, buf, false);
+  }
+  double sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+  close(fd);
+  std::cout << name << " " << path << ": " << (int)(count / sec) << " req/s " << (int)(count * size / sec / 1024 / 1024) << " MB/s" << std::endl;
+}
+
+static void writeFile(const std::string &path, const std::string &data)
+{
+  std::ofstream ofs(path, std::ios::binary | std::ios::trunc);
+  ofs << data;
+}
+
+int main()
+{
+  std::string root = "/tmp/xie_static_" + std::to_string(getpid());
+  mkdir(root.c_str(), 0755);
+  std::string small(4096, 'a');
+  for (size_t i = 0; i < small.size(); ++i)
+  {
+    small[i] = 'a' + i % 26;
+  }
+  std::string large(64 * 1024 * 1024, 'x');
+  writeFile(root + "/small.txt", small);
+  writeFile(root + "/large.bin", large);
+
+  bool ok = true;
+  xie::StaticFileHandler handler(root);
+  xie::FileCache copyCache;
+  {
+    TestServer zeroCopy([&handler](int fd, const xie::HttpRequest &req)
+                        { return handler.handle(fd, req); });
+    int fd = connectTo(zeroCopy.getPort());
+    std::string buf;
+    Response rsp;
+    ok = ok && fetch(fd, "GET /small.txt HTTP/1.1\r\n\r\n", rsp, buf) && rsp.status == 200 && rsp.body == small;
+    ok = ok && rsp.headers.find("Content-Type: text/plain") != std::string::npos;
+    size_t etagPos = rsp.headers.find("ETag: ");
+    std::string etag = rsp.headers.substr(etagPos + 6, rsp.headers.find("\r\n", etagPos) - etagPos - 6);
+    ok = ok && fetch(fd, "GET /small.txt HTTP/1.1\r\nRange: bytes=100-199\r\n\r\n", rsp, buf) && rsp.status == 206 && rsp.body == small.substr(100, 100);
+    ok = ok && rsp.headers.find("Content-Range: bytes 100-199/4096") != std::string::npos;
+    ok = ok && fetch(fd, "GET /small.txt HTTP/1.1\r\nRange: bytes=-10\r\n\r\n", rsp, buf) && rsp.status == 206 && rsp.body == small.substr(4086);
+    ok = ok && fetch(fd, "GET /small.txt HTTP/1.1\r\nRange: bytes=5000-\r\n\r\n", rsp, buf) && rsp.status == 416;
+    ok = ok && fetch(fd, "HEAD /large.bin HTTP/1.1\r\n\r\n", rsp, buf, true, true) && rsp.status == 200 && rsp.length == large.size();
+    ok = ok && fetch(fd, "GET /small.txt HTTP/1.1\r\nIf-None-Match: " + etag + "\r\n\r\n", rsp, buf) && rsp.status == 304;
+    ok = ok && fetch(fd, "GET /missing HTTP/1.1\r\n\r\n", rsp, buf) && rsp.status == 404;
+    ok = ok && fetch(fd, "GET /../etc/passwd HTTP/1.1\r\n\r\n", rsp, buf) && rsp.status == 403;
+    ok = ok && fetch(fd, "POST /small.txt HTTP/1.1\r\n\r\n", rsp, buf) && rsp.status == 405;
+    std::cout << "correctness: " << (ok ? "ok" : "failed") << std::endl;
+
+    // 修改文件后缓存经inotify失效
+    writeFile(root + "/small.txt", "changed");
+    bool changed = false;
+    for (int i = 0; i < 100 && !changed; ++i)
+    {
+      changed = fetch(fd, "GET /small.txt HTTP/1.1\r\n\r\n", rsp, buf) && rsp.body == "changed";
+      if (!changed)
+      {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+      }
+    }
+    std::cout << "invalidation: " << (changed ? "ok" : "failed") << " invalidations=" << handler.getCache().getInvalidations() << std::endl;
+    ok = ok && changed;
+    writeFile(root + "/small.txt", small);
+    close(fd);
+
+    bench("sendfile", zeroCopy.getPort(), "/small.txt", 20000, small.size());
+    bench("sendfile", zeroCopy.getPort(), "/large.bin", 20, large.size());
+  }
+  {
+    TestServer copy([&copyCache, &root](int fd, const xie::HttpRequest &req)
+                    { return copyHandler(copyCache, root, fd, req); });
+    bench("read+write", copy.getPort(), "/small.txt", 20000, small.size());
+    bench("read+write", copy.getPort(), "/large.bin", 20, large.size());
+  }
+  std::cout << "cache hits=" << handler.getCache().getHits() << " misses=" << handler.getCache().getMisses() << std::endl;
+
+  unlink((root + "/small.txt").c_str());
+  unlink((root + "/large.bin").c_str());
+  rmdir(root.c_str());
+  std::cout << (ok ? "PASS" : "FAIL") << std::endl;
+  return ok ? 0 : 1;
+}
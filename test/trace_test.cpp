@@ -0,0 +1,95 @@
+#include "log.h"
+#include "trace.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+static const int kThreads = 4;
+static const int kSpans = 10000;
+
+static void work(int n)
+{
+  XIE_TRACE_FUNC();
+  volatile int sum = 0;
+  for (int i = 0; i < n; ++i)
+  {
+    sum += i;
+  }
+}
+
+static size_t countOf(const std::string &str, const std::string &sub)
+{
+  size_t n = 0;
+  for (size_t pos = str.find(sub); pos != std::string::npos; pos = str.find(sub, pos + 1))
+  {
+    ++n;
+  }
+  return n;
+}
+
+int main()
+{
+  // 关闭追踪时的开销
+  auto begin = std::chrono::steady_clock::now();
+  for (int i = 0; i < 10000000; ++i)
+  {
+    XIE_TRACE_SCOPE("disabled");
+  }
+  double disabled = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - begin).count() / 10000000;
+
+  xie::TraceExporter::ptr exporter(new xie::TraceExporter("./trace.json", 50));
+  if (!exporter->start())
+  {
+    std::cout << "open trace.json failed" << std::endl;
+    return 1;
+  }
+
+  // 开启追踪时的开销, 事件数不超过缓冲大小, 不会丢弃
+  begin = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < xie::TraceRing::kSize - 1; ++i)
+  {
+    XIE_TRACE_SCOPE("enabled");
+  }
+  double enabled = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - begin).count() / (xie::TraceRing::kSize - 1);
+  std::cout << "span cost: disabled=" << disabled << "ns enabled=" << enabled << "ns" << std::endl;
+
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kThreads; ++t)
+  {
+    threads.push_back(std::thread([]()
+                                  {
+                                    for (int i = 0; i < kSpans; ++i)
+                                    {
+                                      XIE_TRACE_SCOPE("outer");
+                                      work(100);
+                                    } }));
+  }
+  for (auto &i : threads)
+  {
+    i.join();
+  }
+  exporter->stop();
+
+  std::ifstream ifs("./trace.json");
+  std::stringstream ss;
+  ss << ifs.rdbuf();
+  std::string json = ss.str();
+  size_t spans = countOf(json, "\"ph\":\"X\"");
+  size_t expect = xie::TraceRing::kSize - 1 + kThreads * kSpans * 2;
+  uint64_t dropped = xie::Tracer::GetDropped();
+  std::cout << "spans=" << spans << " dropped=" << dropped << " expect=" << expect << std::endl;
+
+  // %r输出进程启动以来的毫秒数
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  xie::Logger::ptr logger(new xie::Logger);
+  xie::logAppender::ptr appender(new xie::StdoutLogAppender);
+  appender->setFormat(xie::logFormatter::ptr(new xie::logFormatter("%r%T%t%T%m%n")));
+  logger->addAppender(appender);
+  XIE_LOG_INFO(logger) << "elapse ms";
+  bool ok = spans + dropped == expect && json.back() == '}' && xie::getElapseMS() >= 20;
+  std::cout << (ok ? "PASS" : "FAIL") << std::endl;
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,146 @@
+#include "log_reader.h"
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <chrono>
+#include <iostream>
+
+static void usage(const char *prog)
+{
+  std::cerr << "usage: " << prog << " [options] logfile\n"
+            << "  -b time     开始时间, \"YYYY-mm-dd HH:MM:SS\"或秒级时间戳\n"
+            << "  -e time     结束时间(包含)\n"
+            << "  -l levels   级别, 逗号分隔, 如 WARN,ERROR\n"
+            << "  -c logger   logger名, 同时匹配其子logger\n"
+            << "  -j threads  扫描线程数, 默认使用全部核\n"
+            << "  -p pattern  日志格式, 默认取索引中记录的格式\n"
+            << "  -s          在stderr输出统计信息\n";
+}
+
+static bool parseTime(const char *str, int64_t &out)
+{
+  char *end = nullptr;
+  long long v = strtoll(str, &end, 10);
+  if (*str && !*end)
+  {
+    out = v;
+    return true;
+  }
+  struct tm tm;
+  memset(&tm, 0, sizeof(tm));
+  const char *rt = strptime(str, "%Y-%m-%d %H:%M:%S", &tm);
+  if (!rt || *rt)
+  {
+    return false;
+  }
+  tm.tm_isdst = -1;
+  out = mktime(&tm);
+  return true;
+}
+
+static bool parseLevels(const std::string &str, uint32_t &mask)
+{
+  mask = 0;
+  size_t begin = 0;
+  while (begin <= str.size())
+  {
+    size_t end = str.find(',', begin);
+    std::string name = str.substr(begin, end == std::string::npos ? std::string::npos : end - begin);
+    bool found = false;
+    for (int l = xie::LogLevel::DEBUG; l <= xie::LogLevel::FATAL; ++l)
+    {
+      if (name == xie::LogLevel::toString((xie::LogLevel::Level)l))
+      {
+        mask |= 1u << l;
+        found = true;
+      }
+    }
+    if (!found)
+    {
+      return false;
+    }
+    if (end == std::string::npos)
+    {
+      break;
+    }
+    begin = end + 1;
+  }
+  return true;
+}
+
+int main(int argc, char **argv)
+{
+  xie::LogReader::Query q;
+  std::string pattern;
+  bool stats = false;
+  int opt;
+  while ((opt = getopt(argc, argv, "b:e:l:c:j:p:sh")) != -1)
+  {
+    switch (opt)
+    {
+    case 'b':
+    case 'e':
+      if (!parseTime(optarg, opt == 'b' ? q.begin : q.end))
+      {
+        std::cerr << "invalid time: " << optarg << std::endl;
+        return 2;
+      }
+      break;
+    case 'l':
+      if (!parseLevels(optarg, q.level_mask))
+      {
+        std::cerr << "invalid level: " << optarg << std::endl;
+        return 2;
+      }
+      break;
+    case 'c':
+      q.logger = optarg;
+      break;
+    case 'j':
+      q.threads = atoi(optarg);
+      break;
+    case 'p':
+      pattern = optarg;
+      break;
+    case 's':
+      stats = true;
+      break;
+    default:
+      usage(argv[0]);
+      return opt == 'h' ? 0 : 2;
+    }
+  }
+  if (optind >= argc)
+  {
+    usage(argv[0]);
+    return 2;
+  }
+
+  xie::LogReader reader(argv[optind]);
+  if (!reader.open())
+  {
+    std::cerr << "open " << argv[optind] << " failed: " << strerror(errno) << std::endl;
+    return 1;
+  }
+  if (!pattern.empty())
+  {
+    reader.setPattern(pattern);
+  }
+  auto begin = std::chrono::steady_clock::now();
+  xie::LogReader::Stats st;
+  auto records = reader.query(q, &st);
+  double cost = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+  for (auto &i : records)
+  {
+    fwrite(i.data, 1, i.size, stdout);
+  }
+  if (stats)
+  {
+    std::cerr << "index=" << (reader.hasIndex() ? "yes" : "no") << " blocks=" << st.blocks << " scanned=" << st.blocks_scanned
+              << " copied=" << st.blocks_copied << " bytes_scanned=" << st.bytes_scanned << " records=" << st.records
+              << " cost=" << cost << "ms" << std::endl;
+  }
+  return 0;
+}